@@ -0,0 +1,522 @@
+// Real roots of integer polynomials of any degree.
+//
+// We isolate the real roots with the continued fraction method of Vincent,
+// Akritas and Strzebonski: Descartes' rule of signs counts positive roots,
+// and Taylor shifts x -> x + s and x -> 1/(1 + x) split the positive reals
+// until each piece holds exactly one root. The chosen root is then expanded
+// with Lagrange's method, and the Mobius transformation accumulated during
+// isolation is applied with cf_new_mobius_to_cf().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include "cf.h"
+
+// c[0] + c[1] x + ... + c[n] x^n. The zero polynomial has n = -1.
+struct poly_s {
+  int n;
+  mpz_t *c;
+};
+typedef struct poly_s poly_t[1];
+typedef struct poly_s *poly_ptr;
+
+static void poly_init(poly_ptr p, int n) {
+  p->n = n;
+  p->c = malloc(sizeof(mpz_t) * (n < 0 ? 1 : n + 1));
+  for (int i = 0; i <= n; i++) mpz_init(p->c[i]);
+}
+
+static void poly_clear(poly_ptr p) {
+  for (int i = 0; i <= p->n; i++) mpz_clear(p->c[i]);
+  free(p->c);
+}
+
+// Initializes p as a copy of q.
+static void poly_init_set(poly_ptr p, poly_ptr q) {
+  poly_init(p, q->n);
+  for (int i = 0; i <= q->n; i++) mpz_set(p->c[i], q->c[i]);
+}
+
+static void poly_swap(poly_ptr p, poly_ptr q) {
+  struct poly_s t = *p;
+  *p = *q;
+  *q = t;
+}
+
+// Drops leading zero coefficients.
+static void poly_normalize(poly_ptr p) {
+  while (p->n >= 0 && !mpz_sgn(p->c[p->n])) {
+    mpz_clear(p->c[p->n]);
+    p->n--;
+  }
+}
+
+// Divides out the content, leaving a primitive polynomial.
+static void poly_primitive(poly_ptr p) {
+  mpz_t g;
+  mpz_init(g);
+  for (int i = 0; i <= p->n; i++) mpz_gcd(g, g, p->c[i]);
+  if (mpz_cmp_ui(g, 1) > 0) {
+    for (int i = 0; i <= p->n; i++) mpz_divexact(p->c[i], p->c[i], g);
+  }
+  mpz_clear(g);
+}
+
+// Number of sign changes in the coefficient sequence. By Descartes' rule
+// of signs, this bounds the number of positive roots, and is exact when it
+// is 0 or 1.
+static int poly_sign_variations(poly_ptr p) {
+  int v = 0, last = 0;
+  for (int i = 0; i <= p->n; i++) {
+    int s = mpz_sgn(p->c[i]);
+    if (!s) continue;
+    if (last && s != last) v++;
+    last = s;
+  }
+  return v;
+}
+
+// p(x) <- p(x + s).
+static void poly_shift(poly_ptr p, mpz_t s) {
+  for (int i = 0; i < p->n; i++) {
+    for (int j = p->n - 1; j >= i; j--) {
+      mpz_addmul(p->c[j], p->c[j + 1], s);
+    }
+  }
+}
+
+// p(x) <- p(x + 1). Additions only.
+static void poly_shift1(poly_ptr p) {
+  for (int i = 0; i < p->n; i++) {
+    for (int j = p->n - 1; j >= i; j--) {
+      mpz_add(p->c[j], p->c[j], p->c[j + 1]);
+    }
+  }
+}
+
+// p(x) <- x^n p(1/x).
+static void poly_reverse(poly_ptr p) {
+  for (int i = 0, j = p->n; i < j; i++, j--) mpz_swap(p->c[i], p->c[j]);
+}
+
+// p(x) <- p(x) / x, assuming p(0) = 0.
+static void poly_div_x(poly_ptr p) {
+  for (int i = 0; i < p->n; i++) mpz_swap(p->c[i], p->c[i + 1]);
+  mpz_clear(p->c[p->n]);
+  p->n--;
+}
+
+// p(x) <- p(x) / (x - 1), assuming p(1) = 0.
+static void poly_div_x1(poly_ptr p) {
+  // Synthetic division, from the top.
+  for (int i = p->n - 1; i > 0; i--) mpz_add(p->c[i], p->c[i], p->c[i + 1]);
+  poly_div_x(p);
+}
+
+// Returns the sign of p(x). t is a temporary.
+static int poly_sign_at(poly_ptr p, mpz_t x, mpz_t t) {
+  mpz_set_ui(t, 0);
+  for (int i = p->n; i >= 0; i--) {
+    mpz_mul(t, t, x);
+    mpz_add(t, t, p->c[i]);
+  }
+  return mpz_sgn(t);
+}
+
+// Returns the sign of p(1).
+static int poly_sign_at1(poly_ptr p, mpz_t t) {
+  mpz_set_ui(t, 0);
+  for (int i = 0; i <= p->n; i++) mpz_add(t, t, p->c[i]);
+  return mpz_sgn(t);
+}
+
+// r <- a pseudo-remainder of a divided by nonzero b. The result is only
+// correct up to a constant factor, which is all gcd computations need.
+static void poly_prem(poly_ptr r, poly_ptr a, poly_ptr b) {
+  poly_clear(r);
+  poly_init_set(r, a);
+  mpz_t lr;
+  mpz_init(lr);
+  while (r->n >= b->n) {
+    int k = r->n - b->n;
+    mpz_set(lr, r->c[r->n]);
+    for (int i = 0; i <= r->n; i++) mpz_mul(r->c[i], r->c[i], b->c[b->n]);
+    for (int i = 0; i <= b->n; i++) mpz_submul(r->c[i + k], lr, b->c[i]);
+    poly_normalize(r);
+  }
+  mpz_clear(lr);
+}
+
+// g <- primitive greatest common divisor of a and b, via the primitive
+// polynomial remainder sequence.
+static void poly_gcd(poly_ptr g, poly_ptr a, poly_ptr b) {
+  poly_t u, v, r;
+  poly_init_set(u, a);
+  poly_init_set(v, b);
+  poly_init(r, -1);
+  poly_primitive(u);
+  poly_primitive(v);
+  while (v->n > 0) {
+    poly_prem(r, u, v);
+    poly_swap(u, v);
+    poly_swap(v, r);
+    poly_primitive(v);
+  }
+  poly_clear(g);
+  if (v->n < 0) {
+    poly_init_set(g, u);
+  } else {
+    // Nonzero constant: coprime.
+    poly_init(g, 0);
+    mpz_set_ui(g->c[0], 1);
+  }
+  poly_clear(u);
+  poly_clear(v);
+  poly_clear(r);
+}
+
+// a <- a / b where b divides a exactly over the integers.
+static void poly_divexact(poly_ptr a, poly_ptr b) {
+  poly_t q;
+  poly_init(q, a->n - b->n);
+  for (int i = q->n; i >= 0; i--) {
+    mpz_divexact(q->c[i], a->c[i + b->n], b->c[b->n]);
+    for (int j = 0; j <= b->n; j++) mpz_submul(a->c[i + j], q->c[i], b->c[j]);
+  }
+  poly_swap(a, q);
+  poly_clear(q);
+}
+
+// Removes repeated factors, since Descartes' rule never isolates
+// a multiple root.
+static void poly_squarefree(poly_ptr p) {
+  poly_t d, g;
+  poly_init(d, p->n - 1);
+  for (int i = 1; i <= p->n; i++) mpz_mul_ui(d->c[i - 1], p->c[i], i);
+  poly_init(g, -1);
+  poly_gcd(g, p, d);
+  if (g->n > 0) poly_divexact(p, g);
+  poly_primitive(p);
+  poly_clear(d);
+  poly_clear(g);
+}
+
+// Upper bound 2^e on the positive roots of p, or returns 0 if there are
+// none. A power of two version of Cauchy's rule: if there are k negative
+// coefficients (with positive leading coefficient), every positive root
+// is at most the maximum over negative c[i] of (-k c[i] / c[n])^(1/(n-i)).
+static int poly_root_bound_2exp(long *e, poly_ptr p) {
+  int s = mpz_sgn(p->c[p->n]);
+  int k = 0;
+  for (int i = 0; i < p->n; i++) if (mpz_sgn(p->c[i]) == -s) k++;
+  if (!k) return 0;
+  long kbits = 0;
+  while (k >> kbits) kbits++;
+  long nbits = mpz_sizeinbase(p->c[p->n], 2) - 1;
+  int first = 1;
+  for (int i = 0; i < p->n; i++) {
+    if (mpz_sgn(p->c[i]) != -s) continue;
+    long num = (long) mpz_sizeinbase(p->c[i], 2) + kbits - nbits;
+    long d = p->n - i;
+    // Round num/d up, for either sign of num.
+    long f = num >= 0 ? (num + d - 1) / d : -(-num / d);
+    if (first || f > *e) *e = f;
+    first = 0;
+  }
+  return 1;
+}
+
+// An isolated root: either a polynomial q with exactly one positive root y
+// and the root is (a y + b)/(c y + d), or an exact rational root b/d.
+struct root_s {
+  poly_t q;
+  mpz_t m[4];
+  int rational;
+};
+typedef struct root_s *root_ptr;
+
+struct rootlist_s {
+  int n, alloc;
+  root_ptr r;
+};
+typedef struct rootlist_s rootlist_t[1];
+typedef struct rootlist_s *rootlist_ptr;
+
+static root_ptr rootlist_add(rootlist_ptr list, mpz_t m[4]) {
+  if (list->n == list->alloc) {
+    list->alloc = list->alloc ? 2 * list->alloc : 8;
+    list->r = realloc(list->r, sizeof(*list->r) * list->alloc);
+  }
+  root_ptr r = list->r + list->n++;
+  for (int i = 0; i < 4; i++) {
+    mpz_init(r->m[i]);
+    mpz_set(r->m[i], m[i]);
+  }
+  return r;
+}
+
+static void rootlist_clear(rootlist_ptr list) {
+  for (int i = 0; i < list->n; i++) {
+    root_ptr r = list->r + i;
+    if (!r->rational) poly_clear(r->q);
+    for (int j = 0; j < 4; j++) mpz_clear(r->m[j]);
+  }
+  free(list->r);
+}
+
+// Records the rational root (a y + b)/(c y + d) at y = 0.
+static void add_rational(rootlist_ptr list, mpz_t m[4]) {
+  root_ptr r = rootlist_add(list, m);
+  r->rational = 1;
+  mpz_set_ui(r->m[0], 1);
+  mpz_set_ui(r->m[2], 0);
+}
+
+// Finds the positive roots of q, reporting them in terms of the Mobius
+// transformation m. Consumes q and m.
+static void isolate(rootlist_ptr list, poly_ptr q, mpz_t m[4]) {
+  mpz_t t;
+  mpz_init(t);
+  for (;;) {
+    if (!mpz_sgn(q->c[0])) {
+      add_rational(list, m);
+      poly_div_x(q);
+    }
+    int v = poly_sign_variations(q);
+    if (v == 0) break;
+    if (v == 1) {
+      root_ptr r = rootlist_add(list, m);
+      r->rational = 0;
+      poly_init(r->q, -1);
+      poly_swap(r->q, q);
+      break;
+    }
+
+    // Shift by a lower bound on the positive roots, if it is at least 1.
+    long e = 0;
+    poly_reverse(q);
+    int found = poly_root_bound_2exp(&e, q);
+    poly_reverse(q);
+    if (found && e < 0) {
+      mpz_set_ui(t, 0);
+      mpz_setbit(t, -e);
+      poly_shift(q, t);
+      mpz_addmul(m[1], m[0], t);
+      mpz_addmul(m[3], m[2], t);
+      continue;
+    }
+
+    // Split at 1.
+    if (!poly_sign_at1(q, t)) {
+      mpz_t m1[4];
+      for (int i = 0; i < 4; i++) mpz_init(m1[i]);
+      mpz_add(m1[1], m[0], m[1]);
+      mpz_add(m1[3], m[2], m[3]);
+      add_rational(list, m1);
+      for (int i = 0; i < 4; i++) mpz_clear(m1[i]);
+      poly_div_x1(q);
+    }
+    // Roots in (0, 1): x -> 1/(1 + x).
+    poly_t q0;
+    poly_init_set(q0, q);
+    poly_reverse(q0);
+    poly_shift1(q0);
+    mpz_t m0[4];
+    for (int i = 0; i < 4; i++) mpz_init(m0[i]);
+    mpz_set(m0[0], m[1]); mpz_add(m0[1], m[0], m[1]);
+    mpz_set(m0[2], m[3]); mpz_add(m0[3], m[2], m[3]);
+    isolate(list, q0, m0);
+    for (int i = 0; i < 4; i++) mpz_clear(m0[i]);
+    poly_clear(q0);
+    // Roots in (1, infinity): x -> x + 1.
+    poly_shift1(q);
+    mpz_add(m[1], m[1], m[0]);
+    mpz_add(m[3], m[3], m[2]);
+  }
+  mpz_clear(t);
+}
+
+// Compares the intervals (a/c, b/d) holding isolated roots, which are
+// disjoint, by their left endpoints. If c = 0 then a/c is infinite.
+static int root_cmp(const void *x, const void *y) {
+  const struct root_s *r = x, *s = y;
+  mpq_t u, v;
+  mpq_init(u); mpq_init(v);
+  mpq_set_num(u, r->m[1]); mpq_set_den(u, r->m[3]);
+  mpq_set_num(v, s->m[1]); mpq_set_den(v, s->m[3]);
+  mpq_canonicalize(u); mpq_canonicalize(v);
+  mpq_t w;
+  mpq_init(w);
+  if (mpz_sgn(r->m[2])) {
+    mpq_set_num(w, r->m[0]); mpq_set_den(w, r->m[2]);
+    mpq_canonicalize(w);
+    if (mpq_cmp(w, u) < 0) mpq_set(u, w);
+  }
+  if (mpz_sgn(s->m[2])) {
+    mpq_set_num(w, s->m[0]); mpq_set_den(w, s->m[2]);
+    mpq_canonicalize(w);
+    if (mpq_cmp(w, v) < 0) mpq_set(v, w);
+  }
+  int res = mpq_cmp(u, v);
+  mpq_clear(u); mpq_clear(v); mpq_clear(w);
+  return res;
+}
+
+// Isolates the positive roots of p, in increasing order.
+static void isolate_positive(rootlist_ptr list, poly_ptr p) {
+  poly_t q;
+  poly_init_set(q, p);
+  mpz_t m[4];
+  for (int i = 0; i < 4; i++) mpz_init(m[i]);
+  mpz_set_ui(m[0], 1);
+  mpz_set_ui(m[3], 1);
+  // Zero is not positive.
+  while (q->n >= 0 && !mpz_sgn(q->c[0])) poly_div_x(q);
+  isolate(list, q, m);
+  qsort(list->r, list->n, sizeof(*list->r), root_cmp);
+  for (int i = 0; i < 4; i++) mpz_clear(m[i]);
+  poly_clear(q);
+}
+
+// Finds the integer part lo of the unique positive root of q, by
+// exponential then binary search for the first sign change. Returns 1 if
+// the root is exactly hi. mid and t are temporaries.
+static int floor_root(mpz_t lo, mpz_t hi, poly_ptr q, mpz_t mid, mpz_t t) {
+  mpz_set_ui(lo, 0);
+  int s0 = mpz_sgn(q->c[0]);
+  mpz_set_ui(hi, 1);
+  while (poly_sign_at(q, hi, t) == s0) {
+    mpz_set(lo, hi);
+    mpz_mul_2exp(hi, hi, 1);
+  }
+  for (;;) {
+    mpz_add(mid, lo, hi);
+    mpz_fdiv_q_2exp(mid, mid, 1);
+    if (!mpz_cmp(mid, lo)) break;
+    if (poly_sign_at(q, mid, t) == s0) {
+      mpz_set(lo, mid);
+    } else {
+      mpz_set(hi, mid);
+    }
+  }
+  return !poly_sign_at(q, hi, t);
+}
+
+// Lagrange's method: expands the unique positive root of a polynomial.
+static void *lagrange(cf_t cf) {
+  poly_ptr q = cf_data(cf);
+  mpz_t lo, hi, mid, t;
+  mpz_init(lo); mpz_init(hi); mpz_init(mid); mpz_init(t);
+  while(cf_wait(cf)) {
+    if (floor_root(lo, hi, q, mid, t)) {
+      cf_put(cf, hi);
+      cf_put_end(cf);
+      break;
+    }
+    cf_put(cf, lo);
+    // Root = lo + 1/y for the new root y > 1.
+    poly_shift(q, lo);
+    poly_reverse(q);
+  }
+  mpz_clear(lo); mpz_clear(hi); mpz_clear(mid); mpz_clear(t);
+  poly_clear(q);
+  free(q);
+  return NULL;
+}
+
+struct algebraic_data_s {
+  struct root_s root;
+  int sign;
+};
+typedef struct algebraic_data_s *algebraic_data_ptr;
+
+static void *algebraic(cf_t cf) {
+  algebraic_data_ptr ad = cf_data(cf);
+  root_ptr r = &ad->root;
+  mpz_t z;
+  mpz_init(z);
+  cf_set_sign(cf, ad->sign);
+  if (r->rational) {
+    if (cf_wait(cf)) cf_put_rational(cf, r->m[1], r->m[3]);
+  } else {
+    poly_ptr q = malloc(sizeof(*q));
+    poly_init(q, -1);
+    poly_swap(q, r->q);
+    cf_t y = cf_new(lagrange, q);
+    cf_t conv = cf_new_mobius_to_cf(y, r->m);
+    while(cf_wait(cf)) {
+      if (!cf_get(z, conv)) {
+        cf_put_end(cf);
+        break;
+      }
+      cf_put(cf, z);
+    }
+    cf_free(conv);
+    cf_free(y);
+    poly_clear(r->q);
+  }
+  for (int i = 0; i < 4; i++) mpz_clear(r->m[i]);
+  mpz_clear(z);
+  free(ad);
+  return NULL;
+}
+
+// Real root number k (counting from 0 in increasing order) of
+//   poly[0] + poly[1] x + ... + poly[n] x^n.
+// Returns NULL if there are not that many real roots. Rational roots have
+// finite expansions.
+cf_t cf_new_algebraic(mpz_t *poly, int n, int k) {
+  poly_t p;
+  poly_init(p, n);
+  for (int i = 0; i <= n; i++) mpz_set(p->c[i], poly[i]);
+  poly_normalize(p);
+  if (p->n <= 0 || k < 0) {
+    poly_clear(p);
+    return NULL;
+  }
+  poly_squarefree(p);
+
+  // Negative roots are positive roots of p(-x).
+  poly_t pneg;
+  poly_init_set(pneg, p);
+  for (int i = 1; i <= pneg->n; i += 2) mpz_neg(pneg->c[i], pneg->c[i]);
+  rootlist_t neg, pos;
+  neg->n = neg->alloc = 0; neg->r = NULL;
+  pos->n = pos->alloc = 0; pos->r = NULL;
+  isolate_positive(neg, pneg);
+  isolate_positive(pos, p);
+  int zero = !mpz_sgn(p->c[0]);
+  poly_clear(pneg);
+  poly_clear(p);
+
+  algebraic_data_ptr ad = malloc(sizeof(*ad));
+  root_ptr r = NULL;
+  ad->sign = 1;
+  for (int i = 0; i < 4; i++) mpz_init(ad->root.m[i]);
+  if (k < neg->n) {
+    r = neg->r + neg->n - 1 - k;
+    ad->sign = -1;
+  } else if (zero && k == neg->n) {
+    // The root 0/1.
+    ad->root.rational = 1;
+    mpz_set_ui(ad->root.m[3], 1);
+  } else if (k - neg->n - zero < pos->n) {
+    r = pos->r + k - neg->n - zero;
+  } else {
+    for (int i = 0; i < 4; i++) mpz_clear(ad->root.m[i]);
+    free(ad);
+    ad = NULL;
+  }
+  if (r) {
+    ad->root.rational = r->rational;
+    for (int i = 0; i < 4; i++) mpz_set(ad->root.m[i], r->m[i]);
+    if (!r->rational) {
+      poly_init(ad->root.q, -1);
+      poly_swap(ad->root.q, r->q);
+    }
+  }
+  rootlist_clear(neg);
+  rootlist_clear(pos);
+  if (!ad) return NULL;
+  return cf_new(algebraic, ad);
+}
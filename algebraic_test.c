@@ -0,0 +1,91 @@
+// Test real roots of integer polynomials.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "cf.h"
+#include "test.h"
+
+int main() {
+  mpz_t a[6];
+  int i;
+  for (i = 0; i < 6; i++) mpz_init(a[i]);
+  cf_t x;
+
+  // Cube root of 2: x^3 - 2.
+  mpz_set_si(a[0], -2);
+  mpz_set_si(a[3], 1);
+  x = cf_new_algebraic(a, 3, 0);
+  CF_EXPECT_DEC(x, "1.25992104989487316476");
+  cf_free(x);
+  EXPECT(!cf_new_algebraic(a, 3, 1));
+
+  // x^5 - x - 1 has one real root.
+  mpz_set_si(a[0], -1);
+  mpz_set_si(a[1], -1);
+  mpz_set_si(a[3], 0);
+  mpz_set_si(a[5], 1);
+  x = cf_new_algebraic(a, 5, 0);
+  CF_EXPECT_DEC(x, "1.16730397826141868425");
+  cf_free(x);
+
+  // Both roots of x^2 - x - 1.
+  for (i = 0; i < 6; i++) mpz_set_ui(a[i], 0);
+  mpz_set_si(a[0], -1);
+  mpz_set_si(a[1], -1);
+  mpz_set_si(a[2], 1);
+  x = cf_new_algebraic(a, 2, 0);
+  CF_EXPECT_DEC(x, "-0.61803398874989484820");
+  cf_free(x);
+  x = cf_new_algebraic(a, 2, 1);
+  CF_EXPECT_DEC(x, "1.61803398874989484820");
+  cf_free(x);
+
+  // (x^2 - 2)^2 (x - 3) (100 x^2 - 1) has roots that are repeated, rational,
+  // and close together: -sqrt(2), -1/10, 1/10, sqrt(2), 3.
+  // Expanded: 100 x^7 - 300 x^6 - 401 x^5 + 1203 x^4 + 404 x^3 - 1212 x^2
+  //   - 4 x + 12.
+  mpz_set_si(a[0], 12);
+  mpz_set_si(a[1], -4);
+  mpz_set_si(a[2], -1212);
+  mpz_set_si(a[3], 404);
+  mpz_set_si(a[4], 1203);
+  mpz_set_si(a[5], -401);
+  mpz_t b[8];
+  for (i = 0; i < 8; i++) mpz_init(b[i]);
+  for (i = 0; i < 6; i++) mpz_set(b[i], a[i]);
+  mpz_set_si(b[6], -300);
+  mpz_set_si(b[7], 100);
+  x = cf_new_algebraic(b, 7, 0);
+  CF_EXPECT_DEC(x, "-1.41421356237309504880");
+  cf_free(x);
+  x = cf_new_algebraic(b, 7, 1);
+  CF_EXPECT_DEC(x, "-0.10000");
+  cf_free(x);
+  x = cf_new_algebraic(b, 7, 2);
+  CF_EXPECT_DEC(x, "0.10000");
+  cf_free(x);
+  x = cf_new_algebraic(b, 7, 3);
+  CF_EXPECT_DEC(x, "1.41421356237309504880");
+  cf_free(x);
+  x = cf_new_algebraic(b, 7, 4);
+  CF_EXPECT_DEC(x, "3.00000");
+  cf_free(x);
+  EXPECT(!cf_new_algebraic(b, 7, 5));
+
+  // Rational roots that isolation leaves inside an interval: x (2x - 3).
+  for (i = 0; i < 6; i++) mpz_set_ui(a[i], 0);
+  mpz_set_si(a[1], -3);
+  mpz_set_si(a[2], 2);
+  x = cf_new_algebraic(a, 2, 0);
+  CF_EXPECT_DEC(x, "0.00000");
+  cf_free(x);
+  x = cf_new_algebraic(a, 2, 1);
+  CF_EXPECT_DEC(x, "1.50000");
+  cf_free(x);
+
+  for (i = 0; i < 8; i++) mpz_clear(b[i]);
+  for (i = 0; i < 6; i++) mpz_clear(a[i]);
+  return 0;
+}
@@ -0,0 +1,195 @@
+// Memory for GMP from size classes, cached per thread.
+//
+// Limbs often move between threads: a node fills an mpz_t, cf_put() copies
+// it onto a channel, and the reader frees it. A block freed by any thread
+// goes into that thread's cache, and caches that grow too big, or belong to
+// threads that exit, hand blocks back to a shared depot for each class.
+// Blocks are never returned to the system, except large ones, which bypass
+// the classes.
+#define _GNU_SOURCE  // For mremap() and MADV_HUGEPAGE.
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <gmp.h>
+#include "cf.h"
+
+// Class k holds blocks of 16 << k bytes. Each thread keeps up to CACHE_MAX
+// blocks of a class, and moves them to and from the depot BATCH at a time.
+enum { MIN_SHIFT = 4, NCLASS = 13, CACHE_MAX = 64, BATCH = 32 };
+enum { SLAB_SIZE = 1 << 16 };
+enum { MAX_SMALL = (1 << MIN_SHIFT) << (NCLASS - 1) };
+// With huge pages, allocations this big are mapped separately.
+enum { HUGE_SIZE = 1 << 21 };
+
+struct block_s {
+  struct block_s *next;
+};
+typedef struct block_s *block_ptr;
+
+struct cache_s {
+  block_ptr head[NCLASS];
+  int n[NCLASS];
+};
+
+static __thread struct cache_s cache;
+static __thread int cache_registered;
+static pthread_key_t cache_key;
+
+static struct {
+  pthread_mutex_t mu;
+  block_ptr head;
+} depot[NCLASS];
+
+static int use_huge;
+
+static int size_class(size_t size) {
+  if (size <= 1 << MIN_SHIFT) return 0;
+  return 8 * sizeof(unsigned long) - __builtin_clzl(size - 1) - MIN_SHIFT;
+}
+
+// Moves n blocks of class k from the front of list to the depot, and
+// returns the rest.
+static block_ptr give_back(int k, block_ptr list, int n) {
+  block_ptr first = list, last = list;
+  for (int i = 1; i < n && last->next; i++) last = last->next;
+  block_ptr rest = last->next;
+  pthread_mutex_lock(&depot[k].mu);
+  last->next = depot[k].head;
+  depot[k].head = first;
+  pthread_mutex_unlock(&depot[k].mu);
+  return rest;
+}
+
+// Hands the blocks of an exiting thread back.
+static void cache_flush(void *data) {
+  struct cache_s *c = data;
+  for (int k = 0; k < NCLASS; k++) {
+    if (c->head[k]) give_back(k, c->head[k], c->n[k]);
+    c->head[k] = NULL;
+    c->n[k] = 0;
+  }
+}
+
+// Fills the empty cache of class k from the depot, or from a new slab.
+static void refill(int k) {
+  size_t size = (size_t) 1 << (k + MIN_SHIFT);
+  if (!cache_registered) {
+    pthread_setspecific(cache_key, &cache);
+    cache_registered = 1;
+  }
+  pthread_mutex_lock(&depot[k].mu);
+  block_ptr b = depot[k].head;
+  int n = 0;
+  if (b) {
+    block_ptr last = b;
+    for (n = 1; n < BATCH && last->next; n++) last = last->next;
+    depot[k].head = last->next;
+    last->next = NULL;
+  }
+  pthread_mutex_unlock(&depot[k].mu);
+  if (!b) {
+    size_t slab = size * BATCH < SLAB_SIZE ? SLAB_SIZE : size * 4;
+    char *p = malloc(slab);
+    if (!p) {
+      fprintf(stderr, "arena: out of memory\n");
+      abort();
+    }
+    for (n = slab / size; n > 0; n--) {
+      block_ptr nb = (block_ptr) (p + (n - 1) * size);
+      nb->next = b;
+      b = nb;
+    }
+    n = slab / size;
+  }
+  cache.head[k] = b;
+  cache.n[k] = n;
+}
+
+static void *large_alloc(size_t size) {
+  void *p;
+  if (use_huge && size >= HUGE_SIZE) {
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+        -1, 0);
+    if (p == MAP_FAILED) p = NULL;
+    else madvise(p, size, MADV_HUGEPAGE);
+  } else {
+    p = malloc(size);
+  }
+  if (!p) {
+    fprintf(stderr, "arena: out of memory\n");
+    abort();
+  }
+  return p;
+}
+
+static void large_free(void *p, size_t size) {
+  if (use_huge && size >= HUGE_SIZE) munmap(p, size);
+  else free(p);
+}
+
+static void *arena_alloc(size_t size) {
+  if (size > MAX_SMALL) return large_alloc(size);
+  int k = size_class(size);
+  if (!cache.head[k]) refill(k);
+  block_ptr b = cache.head[k];
+  cache.head[k] = b->next;
+  cache.n[k]--;
+  return b;
+}
+
+static void arena_free(void *p, size_t size) {
+  if (size > MAX_SMALL) {
+    large_free(p, size);
+    return;
+  }
+  int k = size_class(size);
+  block_ptr b = p;
+  b->next = cache.head[k];
+  cache.head[k] = b;
+  if (++cache.n[k] > CACHE_MAX) {
+    if (!cache_registered) {
+      pthread_setspecific(cache_key, &cache);
+      cache_registered = 1;
+    }
+    cache.head[k] = give_back(k, b, BATCH);
+    cache.n[k] -= BATCH;
+  }
+}
+
+static void *arena_realloc(void *p, size_t old, size_t size) {
+  if (old > MAX_SMALL && size > MAX_SMALL) {
+    if (!use_huge || (old < HUGE_SIZE && size < HUGE_SIZE)) {
+      if (!(p = realloc(p, size))) {
+        fprintf(stderr, "arena: out of memory\n");
+        abort();
+      }
+      return p;
+    }
+    if (old >= HUGE_SIZE && size >= HUGE_SIZE) {
+      void *q = mremap(p, old, size, MREMAP_MAYMOVE);
+      if (q != MAP_FAILED) {
+        madvise(q, size, MADV_HUGEPAGE);
+        return q;
+      }
+    }
+  } else if (old <= MAX_SMALL && size <= MAX_SMALL
+      && size_class(old) == size_class(size)) {
+    return p;
+  }
+  void *q = arena_alloc(size);
+  memcpy(q, p, old < size ? old : size);
+  arena_free(p, old);
+  return q;
+}
+
+void cf_arena_init(int hugepages) {
+  for (int k = 0; k < NCLASS; k++) {
+    pthread_mutex_init(&depot[k].mu, NULL);
+    depot[k].head = NULL;
+  }
+  pthread_key_create(&cache_key, cache_flush);
+  use_huge = hugepages;
+  mp_set_memory_functions(arena_alloc, arena_realloc, arena_free);
+}
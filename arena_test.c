@@ -0,0 +1,43 @@
+// Test the GMP allocator of arena.c.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "cf.h"
+#include "test.h"
+
+int main() {
+  cf_arena_init(1);
+
+  // Terms are allocated by one thread and freed by another.
+  cf_t pi = cf_new_pi_chudnovsky();
+  char *s = cf_to_decimal_bulk(pi, 1000, NULL);
+  EXPECT(!strncmp(s, "3.14159265358979323846", 22));
+  EXPECT(strlen(s) == 1002 && !strcmp(s + 992, "2164201989"));
+  free(s);
+  cf_free(pi);
+  for (int i = 0; i < 20; i++) {
+    pi = cf_new_pi();
+    cf_t e = cf_new_e();
+    cf_t x = cf_new_mul(pi, e);
+    CF_EXPECT_DEC(x, "8.53973422267356706546");
+    cf_free(x);
+    cf_free(e);
+    cf_free(pi);
+  }
+
+  // Big enough to be mapped on its own, and grown in place.
+  mpz_t z, w;
+  mpz_init(z); mpz_init(w);
+  mpz_ui_pow_ui(z, 3, 20000000);
+  mpz_mul(w, z, z);
+  mpz_mul(z, z, z);
+  EXPECT(!mpz_cmp(z, w));
+  EXPECT(mpz_divisible_ui_p(z, 81));
+  mpz_realloc2(z, 64);
+  mpz_set_ui(z, 5);
+  EXPECT(!mpz_cmp_ui(z, 5));
+  mpz_clear(z); mpz_clear(w);
+  return 0;
+}
@@ -0,0 +1,261 @@
+// Decimal expansions of many quadratic surds at once.
+//
+// A graph costs a thread per node, which adds up when we want 30 digits of
+// each of thousands of numbers of the same shape. Here one thread runs
+// them all as lanes, in the manner of exercise.c: each lane holds
+//
+//   (a x + b) / (c x + d)
+//
+// in words, where x >= 1 is the rest of the continued fraction of sqrt(k),
+// and each round either emits a digit or takes in a term on every live
+// lane. The state lives in one array per field so the rounds are loops over
+// plain arrays. A lane that would outgrow a word moves to mpz_t and is
+// finished on its own.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "cf.h"
+
+// Coefficients stay below 2^62 in absolute value, so sums of two fit in a
+// word. c and d are never negative, but taking out a digit often leaves b
+// negative, since only a / c and (a + b) / (c + d) need to be.
+enum { LIMIT_BITS = 62 };
+
+static int fits(__int128 x) {
+  return x < (__int128) 1 << LIMIT_BITS && x > -((__int128) 1 << LIMIT_BITS);
+}
+
+// Rounds a / b down, for b > 0.
+static int64_t fdiv(int64_t a, int64_t b) {
+  return a / b - (a % b < 0);
+}
+
+struct batch_s {
+  int n;  // Digits after the point.
+  int64_t *a, *b, *c, *d;
+  // sqrt(k) = [root; ...]. The next term is t, and what follows it is
+  // (sqrt(k) + m) / den.
+  uint64_t *k, *root, *m, *den, *t;
+  // Whether the lane has taken in its first term, after which x >= 1, and
+  // whether it has taken in its last.
+  unsigned char *started, *ended;
+  char **s;
+  int *len;  // Digits emitted so far, counting the integer part as one.
+  int *pos;  // Length of s.
+};
+typedef struct batch_s *batch_ptr;
+
+// The term after t, or sets ended.
+static void next_term(batch_ptr p, int i) {
+  if (p->k[i] == p->root[i] * p->root[i]) {
+    p->ended[i] = 1;
+    return;
+  }
+  p->m[i] = p->den[i] * p->t[i] - p->m[i];
+  p->den[i] = (p->k[i] - p->m[i] * p->m[i]) / p->den[i];
+  p->t[i] = (p->root[i] + p->m[i]) / p->den[i];
+}
+
+static void emit(batch_ptr p, int i, int64_t q) {
+  if (!p->len[i]++) {
+    p->pos[i] = sprintf(p->s[i], "%ld.", (long) q);
+  } else {
+    p->s[i][p->pos[i]++] = '0' + q;
+  }
+  p->s[i][p->pos[i]] = 0;
+}
+
+// Finishes lane i with mpz_t coefficients, from where the words left off,
+// or from z if they never fit.
+static void finish_mpz(batch_ptr p, int i, unsigned long *z) {
+  mpz_t a, b, c, d, q, q1, r, u;
+  mpz_init(q);
+  mpz_init(q1);
+  mpz_init(r);
+  mpz_init(u);
+  if (z) {
+    mpz_init_set_ui(a, z[0]);
+    mpz_init_set_ui(b, z[1]);
+    mpz_init_set_ui(c, z[2]);
+    mpz_init_set_ui(d, z[3]);
+  } else {
+    mpz_init_set_si(a, p->a[i]);
+    mpz_init_set_si(b, p->b[i]);
+    mpz_init_set_si(c, p->c[i]);
+    mpz_init_set_si(d, p->d[i]);
+  }
+  while (p->len[i] <= p->n) {
+    if (p->started[i] && mpz_sgn(c)) {
+      mpz_add(u, c, d);
+      mpz_add(r, a, b);
+      mpz_fdiv_q(q, a, c);
+      mpz_fdiv_q(q1, r, u);
+      if (!mpz_cmp(q, q1)) {
+        if (!p->len[i]) {
+          p->pos[i] = gmp_sprintf(p->s[i], "%Zd.", q);
+          p->len[i]++;
+        } else {
+          emit(p, i, mpz_get_ui(q));
+        }
+        mpz_submul(a, q, c);
+        mpz_submul(b, q, d);
+        mpz_mul_ui(a, a, 10);
+        mpz_mul_ui(b, b, 10);
+        continue;
+      }
+    }
+    // (a x + b) / (c x + d) with x = t + 1/x'.
+    mpz_set(r, a);
+    mpz_mul_ui(a, a, p->t[i]);
+    mpz_add(a, a, b);
+    mpz_set(b, r);
+    mpz_set(r, c);
+    mpz_mul_ui(c, c, p->t[i]);
+    mpz_add(c, c, d);
+    mpz_set(d, r);
+    p->started[i] = 1;
+    next_term(p, i);
+    if (p->ended[i]) {
+      // x' is infinite.
+      mpz_set_ui(b, 0);
+      mpz_set_ui(d, 0);
+      p->t[i] = 0;
+    }
+  }
+  mpz_clear(a);
+  mpz_clear(b);
+  mpz_clear(c);
+  mpz_clear(d);
+  mpz_clear(q);
+  mpz_clear(q1);
+  mpz_clear(r);
+  mpz_clear(u);
+}
+
+// Each round moves every live lane one step. Lanes that finish or outgrow
+// words leave the list.
+static void run(batch_ptr p, int *live, int nlive) {
+  int64_t *q = malloc(sizeof(*q) * nlive);
+  unsigned char *out = malloc(nlive), *big = malloc(nlive);
+  while (nlive) {
+    // Which lanes can emit a digit: those where x = 1 and x = infinity
+    // give the same floor.
+    for (int j = 0; j < nlive; j++) {
+      int i = live[j];
+      int64_t c = p->c[i], cd = c + p->d[i];
+      int ok = p->started[i] && c;
+      int64_t q0 = ok ? fdiv(p->a[i], c) : 0;
+      int64_t q1 = ok ? fdiv(p->a[i] + p->b[i], cd) : 1;
+      out[j] = ok && q0 == q1;
+      q[j] = q0;
+    }
+    // Emit the digit, or take in the next term.
+    for (int j = 0; j < nlive; j++) {
+      int i = live[j];
+      __int128 a, b, c, d;
+      if (out[j]) {
+        a = (p->a[i] - (__int128) q[j] * p->c[i]) * 10;
+        b = (p->b[i] - (__int128) q[j] * p->d[i]) * 10;
+        c = p->c[i];
+        d = p->d[i];
+      } else {
+        a = (__int128) p->a[i] * (int64_t) p->t[i] + p->b[i];
+        b = p->a[i];
+        c = (__int128) p->c[i] * (int64_t) p->t[i] + p->d[i];
+        d = p->c[i];
+      }
+      big[j] = !fits(a) || !fits(b) || !fits(c) || !fits(d);
+      if (big[j]) continue;
+      if (out[j]) {
+        emit(p, i, q[j]);
+      } else {
+        p->started[i] = 1;
+        next_term(p, i);
+        if (p->ended[i]) {
+          b = d = 0;
+          p->t[i] = 0;
+        }
+      }
+      p->a[i] = a;
+      p->b[i] = b;
+      p->c[i] = c;
+      p->d[i] = d;
+    }
+    int k = 0;
+    for (int j = 0; j < nlive; j++) {
+      int i = live[j];
+      if (big[j]) finish_mpz(p, i, NULL);
+      else if (p->len[i] <= p->n) live[k++] = i;
+    }
+    nlive = k;
+  }
+  free(q);
+  free(out);
+  free(big);
+}
+
+void cf_batch_mobius_sqrt(char **out, unsigned long (*z)[4],
+    unsigned long *k, int lanes, int n) {
+  struct batch_s p[1];
+  p->n = n;
+  int64_t **coeff[] = { &p->a, &p->b, &p->c, &p->d };
+  uint64_t **field[] = { &p->k, &p->root, &p->m, &p->den, &p->t };
+  for (int f = 0; f < 4; f++) *coeff[f] = malloc(sizeof(int64_t) * lanes);
+  for (int f = 0; f < sizeof(field) / sizeof(*field); f++) {
+    *field[f] = malloc(sizeof(uint64_t) * lanes);
+  }
+  p->started = calloc(lanes, 1);
+  p->ended = calloc(lanes, 1);
+  p->s = out;
+  p->len = calloc(lanes, sizeof(int));
+  p->pos = calloc(lanes, sizeof(int));
+  int *live = malloc(sizeof(int) * lanes), nlive = 0;
+  mpz_t r;
+  mpz_init(r);
+  for (int i = 0; i < lanes; i++) {
+    out[i] = NULL;
+    // The denominator c sqrt(k) + d must not be zero.
+    if (k[i] >> LIMIT_BITS || (!z[i][3] && (!z[i][2] || !k[i]))) continue;
+    int big = 0;
+    for (int f = 0; f < 4; f++) big |= z[i][f] >> LIMIT_BITS != 0;
+    mpz_set_ui(r, k[i]);
+    mpz_sqrt(r, r);
+    p->k[i] = k[i];
+    p->root[i] = p->t[i] = mpz_get_ui(r);
+    p->m[i] = 0;
+    p->den[i] = 1;
+    // Room for the integer part of the largest values, which are about
+    // 2^64 * sqrt(2^62).
+    out[i] = malloc(48 + n);
+    if (big) {
+      finish_mpz(p, i, z[i]);
+      continue;
+    }
+    p->a[i] = z[i][0];
+    p->b[i] = z[i][1];
+    p->c[i] = z[i][2];
+    p->d[i] = z[i][3];
+    live[nlive++] = i;
+  }
+  mpz_clear(r);
+  run(p, live, nlive);
+  free(live);
+  for (int f = 0; f < 4; f++) free(*coeff[f]);
+  for (int f = 0; f < sizeof(field) / sizeof(*field); f++) free(*field[f]);
+  free(p->started);
+  free(p->ended);
+  free(p->len);
+  free(p->pos);
+}
+
+void cf_batch_sqrt(char **out, unsigned long *k, int lanes, int n) {
+  unsigned long (*z)[4] = malloc(sizeof(*z) * lanes);
+  for (int i = 0; i < lanes; i++) {
+    z[i][0] = z[i][3] = 1;
+    z[i][1] = z[i][2] = 0;
+  }
+  cf_batch_mobius_sqrt(out, z, k, lanes, n);
+  free(z);
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "cf.h"
+#include "test.h"
+
+// The same number from a graph.
+static char *graph_dec(unsigned long z[4], unsigned long k, int n) {
+  mpz_t p, q, m[4];
+  mpz_init_set_ui(p, k);
+  mpz_init_set_ui(q, 1);
+  for (int i = 0; i < 4; i++) mpz_init_set_ui(m[i], z[i]);
+  cf_t x = cf_new_sqrt_pq(p, q);
+  cf_t y = cf_new_mobius_to_cf(x, m);
+  char *s = cf_to_decimal_bulk(y, n, NULL);
+  cf_free(y);
+  cf_free(x);
+  for (int i = 0; i < 4; i++) mpz_clear(m[i]);
+  mpz_clear(p);
+  mpz_clear(q);
+  return s;
+}
+
+int main() {
+  enum { N = 200, DIGITS = 30 };
+  unsigned long k[N], z[N][4];
+  char *out[N];
+  for (int i = 0; i < N; i++) k[i] = i;
+  cf_batch_sqrt(out, k, N, DIGITS);
+  EXPECT(!strcmp(out[2], "1.414213562373095048801688724209"));
+  EXPECT(!strcmp(out[0], "0.000000000000000000000000000000"));
+  EXPECT(!strcmp(out[144], "12.000000000000000000000000000000"));
+  for (int i = 0; i < N; i++) free(out[i]);
+
+  // Small and large coefficients, the largest too big for words from the
+  // start, and huge k.
+  unsigned long c[] = { 0, 1, 2, 3, 7, 100, 12345, 1UL << 40, 1UL << 61,
+      (1UL << 62) + 1, ~0UL };
+  int nc = sizeof(c) / sizeof(*c);
+  for (int i = 0; i < N; i++) {
+    k[i] = i % 3 ? i * 7919 : (1UL << 61) + i;
+    for (int j = 0; j < 4; j++) z[i][j] = c[(i * (j + 3) + j * j) % nc];
+    if (!z[i][2] && !z[i][3]) z[i][3] = 1;
+  }
+  cf_batch_mobius_sqrt(out, z, k, N, DIGITS);
+  for (int i = 0; i < N; i++) {
+    char *s = graph_dec(z[i], k[i], DIGITS);
+    if (!out[i] || strcmp(out[i], s)) {
+      fprintf(stderr, "%s:%d: lane %d: %s, want %s\n", __FILE__, __LINE__, i,
+          out[i] ? out[i] : "NULL", s);
+    }
+    free(s);
+    free(out[i]);
+  }
+
+  // Zero denominators.
+  unsigned long zero[2][4] = { { 1, 0, 0, 0 }, { 1, 1, 1, 0 } };
+  unsigned long k0[2] = { 5, 0 };
+  cf_batch_mobius_sqrt(out, zero, k0, 2, 10);
+  EXPECT(!out[0]);
+  EXPECT(!out[1]);
+  return 0;
+}
@@ -0,0 +1,344 @@
+// Benchmarks: times a fixed set of workloads, and prints a JSON array with
+// one object per workload. Given a file of earlier results, also reports
+// workloads that got slower, and then exits with status 1.
+//
+//   $ make bench
+//
+// Each workload runs in its own process, so that peak RSS and the thread
+// counters cover that workload alone.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <gmp.h>
+#include "cf.h"
+
+// Reads n digits after the point, one at a time.
+static void digits(cf_t x, int n) {
+  mpz_t z;
+  mpz_init(z);
+  cf_t dec = cf_new_cf_to_decimal(x);
+  for (int i = 0; i <= n; i++) cf_get(z, dec);
+  cf_free(dec);
+  mpz_clear(z);
+}
+
+static void pi_digits(int n) {
+  cf_t pi = cf_new_pi_chudnovsky();
+  digits(pi, n);
+  cf_free(pi);
+}
+
+static void pi_bulk(int n) {
+  cf_t pi = cf_new_pi_chudnovsky();
+  free(cf_to_decimal_bulk(pi, n, NULL));
+  cf_free(pi);
+}
+
+// The constant of hakmem.c.
+static void hakmem(int n) {
+  cf_t x = cf_parse("sqrt(3/pi^2+e)/(tanh(sqrt(5))-sin(69))");
+  digits(x, n);
+  cf_free(x);
+}
+
+static void sqrt2_digits(int n) {
+  cf_t x = cf_new_sqrt2();
+  digits(x, n);
+  cf_free(x);
+}
+
+static void e_digits(int n) {
+  cf_t x = cf_new_e();
+  digits(x, n);
+  cf_free(x);
+}
+
+static void cos1_digits(int n) {
+  cf_t x = cf_new_cos1();
+  digits(x, n);
+  cf_free(x);
+}
+
+static void mul_digits(int n) {
+  cf_t x = cf_new_pi(), y = cf_new_e();
+  cf_t xy = cf_new_mul(x, y);
+  digits(xy, n);
+  cf_free(xy);
+  cf_free(y);
+  cf_free(x);
+}
+
+static void newton_digits(int n) {
+  cf_t x = cf_new_e();
+  cf_t y = cf_new_sqrt(x);
+  digits(y, n);
+  cf_free(y);
+  cf_free(x);
+}
+
+// The first n integers above 1 that are not squares, whose square roots
+// the graph can expand: sqrt() of a square never ends.
+static unsigned long *nonsquares(int n) {
+  unsigned long *k = malloc(sizeof(*k) * n);
+  for (unsigned long i = 0, j = 2, r = 1; i < n; j++) {
+    if (j == (r + 1) * (r + 1)) r++;
+    else k[i++] = j;
+  }
+  return k;
+}
+
+// 30 digits of each of n square roots, a graph at a time.
+static void graph_sqrt(int n) {
+  unsigned long *k = nonsquares(n);
+  for (int i = 0; i < n; i++) {
+    cf_t x = cf_new_sqrt_int(k[i], 1);
+    free(cf_to_decimal_bulk(x, 30, NULL));
+    cf_free(x);
+  }
+  free(k);
+}
+
+// The same, as lanes of one batch.
+static void batch_sqrt(int n) {
+  unsigned long *k = nonsquares(n);
+  char **out = malloc(sizeof(*out) * n);
+  cf_batch_sqrt(out, k, n, 30);
+  for (int i = 0; i < n; i++) free(out[i]);
+  free(out);
+  free(k);
+}
+
+// Puts a 1 for each demand, so that each term is a round trip between two
+// threads.
+static void *ping(cf_t cf) {
+  mpz_t z;
+  mpz_init_set_ui(z, 1);
+  while (cf_wait(cf)) cf_put(cf, z);
+  mpz_clear(z);
+  return NULL;
+}
+
+// Puts 64 ones for each demand.
+static void *burst(cf_t cf) {
+  mpz_t z;
+  mpz_init_set_ui(z, 1);
+  while (cf_wait(cf)) for (int i = 0; i < 64; i++) cf_put(cf, z);
+  mpz_clear(z);
+  return NULL;
+}
+
+static void read_terms(cf_t x, int n) {
+  mpz_t z;
+  mpz_init(z);
+  for (int i = 0; i < n; i++) cf_get(z, x);
+  mpz_clear(z);
+  cf_free(x);
+}
+
+static void pingpong(int n) {
+  read_terms(cf_new(ping, NULL), n);
+}
+
+static void burst_terms(int n) {
+  read_terms(cf_new(burst, NULL), n);
+}
+
+// Recorded inputs for the replay workloads, which time one node fed from
+// files instead of from the threads that computed its input.
+static char recorded[2][32];
+
+static void record_path(int k) {
+  strcpy(recorded[k], "/tmp/cfbenchXXXXXX");
+  close(mkstemp(recorded[k]));
+}
+
+static void record_pi(int n) {
+  record_path(0);
+  cf_t pi = cf_new_pi_chudnovsky();
+  cf_t rec = cf_new_recorder(pi, recorded[0]);
+  digits(rec, n);
+  cf_free(rec);
+  cf_free(pi);
+}
+
+static void replay_decimal(int n) {
+  cf_t x = cf_new_from_file(recorded[0]);
+  digits(x, n);
+  cf_free(x);
+  unlink(recorded[0]);
+}
+
+static void record_pi_e(int n) {
+  record_path(0);
+  record_path(1);
+  cf_t x = cf_new_pi(), y = cf_new_e();
+  cf_t xrec = cf_new_recorder(x, recorded[0]);
+  cf_t yrec = cf_new_recorder(y, recorded[1]);
+  cf_t xy = cf_new_mul(xrec, yrec);
+  digits(xy, n);
+  cf_free(xy);
+  cf_free(yrec);
+  cf_free(xrec);
+  cf_free(y);
+  cf_free(x);
+}
+
+static void replay_mul(int n) {
+  cf_t x = cf_new_from_file(recorded[0]), y = cf_new_from_file(recorded[1]);
+  cf_t xy = cf_new_mul(x, y);
+  digits(xy, n);
+  cf_free(xy);
+  cf_free(y);
+  cf_free(x);
+  unlink(recorded[0]);
+  unlink(recorded[1]);
+}
+
+static void pin(int n) {
+  cf_set_affinity(1);
+}
+
+static void spin(int n) {
+  cf_set_spin(1);
+}
+
+static void nospin(int n) {
+  cf_set_spin(0);
+}
+
+static void arena(int n) {
+  cf_arena_init(0);
+}
+
+static struct {
+  char *name;
+  void (*run)(int n);
+  int n;
+  void (*setup)(int n);  // If not NULL, runs first, untimed.
+} workload[] = {
+  { "pi_1k", pi_digits, 1000 },
+  { "pi_5k", pi_digits, 5000 },
+  { "pi_5k_arena", pi_digits, 5000, arena },
+  { "pi_20k_bulk", pi_bulk, 20000 },
+  { "hakmem_1k", hakmem, 1000 },
+  { "hakmem_1k_pinned", hakmem, 1000, pin },
+  { "hakmem_1k_arena", hakmem, 1000, arena },
+  { "sqrt2_5k", sqrt2_digits, 5000 },
+  { "e_5k", e_digits, 5000 },
+  { "cos1_2k", cos1_digits, 2000 },
+  { "mul_pi_e_1k", mul_digits, 1000 },
+  { "mul_pi_e_1k_pinned", mul_digits, 1000, pin },
+  { "newton_sqrt_e_1k", newton_digits, 1000 },
+  { "graph_sqrt_30_1k", graph_sqrt, 1000 },
+  { "batch_sqrt_30_1k", batch_sqrt, 1000 },
+  { "pingpong_200k", pingpong, 200000 },
+  { "pingpong_200k_pinned", pingpong, 200000, pin },
+  { "pingpong_200k_spin", pingpong, 200000, spin },
+  { "pingpong_200k_nospin", pingpong, 200000, nospin },
+  { "burst_1m", burst_terms, 1000000 },
+  { "replay_decimal_pi_5k", replay_decimal, 5000, record_pi },
+  { "replay_mul_pi_e_1k", replay_mul, 1000, record_pi_e },
+};
+enum { NWORKLOAD = sizeof(workload) / sizeof(*workload) };
+
+static double seconds(struct timeval t) {
+  return t.tv_sec + t.tv_usec / 1e6;
+}
+
+// Runs workload k and writes its results as one line of JSON to fp. Terms
+// and nodes from the setup are left out, but its peak RSS and threads are
+// not.
+static void measure(FILE *fp, int k) {
+  struct timespec t0, t1;
+  struct rusage ru0, ru;
+  struct cf_stats_s st0, st;
+  if (workload[k].setup) workload[k].setup(workload[k].n);
+  getrusage(RUSAGE_SELF, &ru0);
+  cf_stats(&st0);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  workload[k].run(workload[k].n);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  getrusage(RUSAGE_SELF, &ru);
+  cf_stats(&st);
+  st.terms -= st0.terms;
+  st.nodes -= st0.nodes;
+  double wall = t1.tv_sec - t0.tv_sec + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+  double cpu = seconds(ru.ru_utime) + seconds(ru.ru_stime)
+      - seconds(ru0.ru_utime) - seconds(ru0.ru_stime);
+  fprintf(fp, "{\"name\": \"%s\", \"wall\": %.4f, \"cpu\": %.4f, "
+      "\"terms\": %lu, \"nodes\": %lu, \"terms_per_node_sec\": %.1f, "
+      "\"peak_rss_kb\": %ld, \"peak_threads\": %lu}\n",
+      workload[k].name, wall, cpu, st.terms, st.nodes,
+      st.nodes && wall > 0 ? st.terms / wall / st.nodes : 0.0,
+      ru.ru_maxrss, st.peak_threads);
+}
+
+// Wall time of the named workload in a file of earlier output, or -1.
+static double baseline_wall(FILE *fp, char *name) {
+  char line[1024], s[64];
+  double wall;
+  rewind(fp);
+  while (fgets(line, sizeof(line), fp)) {
+    if (sscanf(line, " { \"name\": \"%63[^\"]\", \"wall\": %lf", s, &wall) == 2
+        && !strcmp(s, name)) {
+      return wall;
+    }
+  }
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  FILE *base = NULL;
+  if (argc > 1 && !(base = fopen(argv[1], "r"))) {
+    perror(argv[1]);
+    return 2;
+  }
+  int slower = 0;
+  cf_set_stats(1);
+  printf("[\n");
+  for (int k = 0; k < NWORKLOAD; k++) {
+    int fd[2];
+    if (pipe(fd)) {
+      perror("pipe");
+      return 2;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (!pid) {
+      close(fd[0]);
+      FILE *fp = fdopen(fd[1], "w");
+      measure(fp, k);
+      fclose(fp);
+      _exit(0);
+    }
+    close(fd[1]);
+    FILE *fp = fdopen(fd[0], "r");
+    char line[1024];
+    int ok = fgets(line, sizeof(line), fp) != NULL;
+    fclose(fp);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!ok || !WIFEXITED(status) || WEXITSTATUS(status)) {
+      fprintf(stderr, "%s: failed\n", workload[k].name);
+      return 2;
+    }
+    line[strcspn(line, "\n")] = 0;
+    printf("  %s%s\n", line, k + 1 < NWORKLOAD ? "," : "");
+    if (!base) continue;
+    double was = baseline_wall(base, workload[k].name), wall;
+    sscanf(strstr(line, "\"wall\":"), "\"wall\": %lf", &wall);
+    // Allow for noise: 25%, and 50ms for the short ones.
+    if (was >= 0 && wall > 1.25 * was + 0.05) {
+      fprintf(stderr, "%s: %.3fs, was %.3fs\n", workload[k].name, wall, was);
+      slower = 1;
+    }
+  }
+  printf("]\n");
+  if (base) fclose(base);
+  return slower;
+}
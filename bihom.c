@@ -54,6 +54,51 @@ void pqrs_print(pqrs_t p) {
   gmp_printf("%Zd/%Zd %Zd/%Zd\n", p->r0, p->r1, p->p0, p->p1);
 }
 
+// A pqrs in machine words, for when all entries are nonnegative and small.
+struct pqrsword_s {
+  long p0, p1;
+  long q0, q1;
+  long r0, r1;
+  long s0, s1;
+};
+typedef struct pqrsword_s pqrsword_t[1];
+typedef struct pqrsword_s *pqrsword_ptr;
+
+// Copies p to w if it fits. Returns 0 otherwise.
+static int pqrsword_set(pqrsword_ptr w, pqrs_t p) {
+  pqrsword_t t;
+  if (!cf_word_get(&t->p0, p->p0) || !cf_word_get(&t->p1, p->p1)
+      || !cf_word_get(&t->q0, p->q0) || !cf_word_get(&t->q1, p->q1)
+      || !cf_word_get(&t->r0, p->r0) || !cf_word_get(&t->r1, p->r1)
+      || !cf_word_get(&t->s0, p->s0) || !cf_word_get(&t->s1, p->s1)) {
+    return 0;
+  }
+  *w = *t;
+  return 1;
+}
+
+static void pqrsword_get(pqrs_t p, pqrsword_ptr w) {
+  mpz_set_si(p->p0, w->p0); mpz_set_si(p->p1, w->p1);
+  mpz_set_si(p->q0, w->q0); mpz_set_si(p->q1, w->q1);
+  mpz_set_si(p->r0, w->r0); mpz_set_si(p->r1, w->r1);
+  mpz_set_si(p->s0, w->s0); mpz_set_si(p->s1, w->s1);
+}
+
+// Sets (a[i], b[i]) = (z a[i] + b[i], a[i]) for i = 0..3, unless this
+// overflows, in which case returns 0 and leaves them alone.
+static int pqrsword_move(long *a[4], long *b[4], mpz_t z) {
+  long d, t[4];
+  if (!cf_word_get(&d, z)) return 0;
+  for (int i = 0; i < 4; i++) {
+    if (!cf_word_muladd(&t[i], d, *a[i], *b[i])) return 0;
+  }
+  for (int i = 0; i < 4; i++) {
+    *b[i] = *a[i];
+    *a[i] = t[i];
+  }
+  return 1;
+}
+
 static void *bihom(cf_t cf) {
   bihom_data_ptr bd = cf_data(cf);
   pqrs_t p;
@@ -66,8 +111,45 @@ static void *bihom(cf_t cf) {
   mpz_t z, t0, t1;
   mpz_init(z);
   mpz_init(t0); mpz_init(t1);
+  // A copy of p in machine words, used instead while small is set.
+  pqrsword_t w;
+  int small = 0;
+  // Once an input ends, its remaining tail is infinite, and only the
+  // latest convergents in its direction matter, so we copy them over the
+  // previous ones, and move the other way from then on.
+  int xend = 0, yend = 0;
+  // Terms are those of |x| and |y|. Signs are only valid once we have read
+  // a term, so on the first term of a negative input we negate the
+  // coefficients of that input.
+  int xstarted = 0, ystarted = 0;
+  auto void move_right();
   void move_down() {
-    cf_get(z, y);
+    if (yend) {
+      if (!xend) move_right();
+      return;
+    }
+    if (!cf_get(z, y)) {
+      yend = 1;
+      if (small) {
+        w->s0 = w->r0; w->s1 = w->r1;
+        w->q0 = w->p0; w->q1 = w->p1;
+      } else {
+        mpz_set(p->s0, p->r0); mpz_set(p->s1, p->r1);
+        mpz_set(p->q0, p->p0); mpz_set(p->q1, p->p1);
+      }
+      return;
+    }
+    if (!ystarted++ && cf_sign(y) < 0) {
+      mpz_neg(p->r0, p->r0); mpz_neg(p->r1, p->r1);
+      mpz_neg(p->p0, p->p0); mpz_neg(p->p1, p->p1);
+    }
+    if (small) {
+      long *a[4] = { &w->r0, &w->r1, &w->p0, &w->p1 };
+      long *b[4] = { &w->s0, &w->s1, &w->q0, &w->q1 };
+      if (pqrsword_move(a, b, z)) return;
+      pqrsword_get(p, w);
+      small = 0;
+    }
     mpz_mul(t0, z, p->r0);  mpz_mul(t1, z, p->r1);
     mpz_add(t0, t0, p->s0); mpz_add(t1, t1, p->s1);
     mpz_set(p->s0, p->r0);  mpz_set(p->s1, p->r1);
@@ -79,7 +161,32 @@ static void *bihom(cf_t cf) {
     mpz_set(p->p0, t0);     mpz_set(p->p1, t1);
   }
   void move_right() {
-    cf_get(z, x);
+    if (xend) {
+      if (!yend) move_down();
+      return;
+    }
+    if (!cf_get(z, x)) {
+      xend = 1;
+      if (small) {
+        w->s0 = w->q0; w->s1 = w->q1;
+        w->r0 = w->p0; w->r1 = w->p1;
+      } else {
+        mpz_set(p->s0, p->q0); mpz_set(p->s1, p->q1);
+        mpz_set(p->r0, p->p0); mpz_set(p->r1, p->p1);
+      }
+      return;
+    }
+    if (!xstarted++ && cf_sign(x) < 0) {
+      mpz_neg(p->q0, p->q0); mpz_neg(p->q1, p->q1);
+      mpz_neg(p->p0, p->p0); mpz_neg(p->p1, p->p1);
+    }
+    if (small) {
+      long *a[4] = { &w->q0, &w->q1, &w->p0, &w->p1 };
+      long *b[4] = { &w->s0, &w->s1, &w->r0, &w->r1 };
+      if (pqrsword_move(a, b, z)) return;
+      pqrsword_get(p, w);
+      small = 0;
+    }
     mpz_mul(t0, z, p->q0);  mpz_mul(t1, z, p->q1);
     mpz_add(t0, t0, p->s0); mpz_add(t1, t1, p->s1);
     mpz_set(p->s0, p->q0);  mpz_set(p->s1, p->q1);
@@ -90,7 +197,9 @@ static void *bihom(cf_t cf) {
     mpz_set(p->r0, p->p0);  mpz_set(p->r1, p->p1);
     mpz_set(p->p0, t0);     mpz_set(p->p1, t1);
   }
-  // Determine sign.
+  // Determine sign, after a term of each input has fixed their signs.
+  move_right();
+  move_down();
   while (mpz_sgn(p->p1) != mpz_sgn(p->q1)
       || mpz_sgn(p->q1) != mpz_sgn(p->r1)
       || mpz_sgn(p->r1) != mpz_sgn(p->s1)
@@ -114,8 +223,60 @@ static void *bihom(cf_t cf) {
     mpz_neg(p->s1, p->s1);
     cf_flip_sign(cf);
   }
+  small = pqrsword_set(w, p);
+
+  // recur() on machine words.
+  int recur_word() {
+    if (xend && yend) return -1;
+    if (!w->s1) {
+      move_right();
+      move_down();
+      return 0;
+    }
+    if (!w->p1) {
+      if (!w->q1) {
+	move_down();
+      } else {
+	move_right();
+      }
+      return 0;
+    }
+    if (!w->q1) {
+      move_down();
+      return 0;
+    }
+    if (!w->r1) {
+      move_right();
+      return 0;
+    }
+    long t = w->p0 / w->p1;
+    if (w->q0 / w->q1 != t) {
+      move_down();
+      return 0;
+    }
+    if (w->r0 / w->r1 != t) {
+      move_right();
+      return 0;
+    }
+    if (w->s0 / w->s1 != t) {
+      move_down();
+      return 0;
+    }
+    mpz_set_si(qr->p0, t);
+    cf_put(cf, qr->p0);
+    long r;
+    r = w->p0 % w->p1; w->p0 = w->p1; w->p1 = r;
+    r = w->q0 % w->q1; w->q0 = w->q1; w->q1 = r;
+    r = w->r0 % w->r1; w->r0 = w->r1; w->r1 = r;
+    r = w->s0 % w->s1; w->s0 = w->s1; w->s1 = r;
+    return 1;
+  }
 
+  // Returns 1 after outputting a term, 0 after reading input, and -1 once
+  // both inputs have ended, leaving the result p0/p1.
   int recur() {
+    if (small) return recur_word();
+    if (xend && yend) return -1;
     if (!mpz_sgn(p->s1)) {
       move_right();
       move_down();
@@ -159,10 +320,29 @@ static void *bihom(cf_t cf) {
     mpz_set(p->q0, p->q1); mpz_set(p->q1, qr->q1);
     mpz_set(p->r0, p->r1); mpz_set(p->r1, qr->r1);
     mpz_set(p->s0, p->s1); mpz_set(p->s1, qr->s1);
+    small = pqrsword_set(w, p);
     return 1;
   }
+  // Pass on the precision readers want, plus a rough allowance for how
+  // much the coefficients can magnify errors.
+  unsigned long gain = 0;
+  for (int i = 0; i < 8; i++) {
+    if (gain < mpz_sizeinbase(bd->a[i], 2)) gain = mpz_sizeinbase(bd->a[i], 2);
+  }
+  gain *= 2;
   while(cf_wait(cf)) {
-    while(!recur());
+    unsigned long bits = cf_bits(cf);
+    if (bits) {
+      cf_want_bits(x, bits + gain);
+      cf_want_bits(y, bits + gain);
+    }
+    int r;
+    while(!(r = recur()));
+    if (r < 0) {
+      if (small) pqrsword_get(p, w);
+      cf_put_rational(cf, p->p0, p->p1);
+      break;
+    }
   }
   pqrs_clear(p);
   pqrs_clear(qr);
@@ -183,7 +363,10 @@ cf_t cf_new_bihom(cf_t x, cf_t y, mpz_t a[8]) {
     mpz_init(p->a[i]);
     mpz_set(p->a[i], a[i]);
   }
-  return cf_new(bihom, p);
+  cf_t res = cf_new(bihom, p);
+  cf_add_input(res, x);
+  cf_add_input(res, y);
+  return res;
 }
 
 void mpz8_init(mpz_t z[8]) {
@@ -246,7 +429,10 @@ cf_t cf_new_add(cf_t x, cf_t y) {
   mpz_set_si(p->a[2], 1);
   mpz_set_si(p->a[7], 1);
 
-  return cf_new(bihom, p);
+  cf_t res = cf_new(bihom, p);
+  cf_add_input(res, x);
+  cf_add_input(res, y);
+  return res;
 }
 
 cf_t cf_new_sub(cf_t x, cf_t y) {
@@ -258,7 +444,10 @@ cf_t cf_new_sub(cf_t x, cf_t y) {
   mpz_set_si(p->a[2], -1);
   mpz_set_si(p->a[7], 1);
 
-  return cf_new(bihom, p);
+  cf_t res = cf_new(bihom, p);
+  cf_add_input(res, x);
+  cf_add_input(res, y);
+  return res;
 }
 
 cf_t cf_new_mul(cf_t x, cf_t y) {
@@ -269,7 +458,10 @@ cf_t cf_new_mul(cf_t x, cf_t y) {
   mpz_set_si(p->a[0], 1);
   mpz_set_si(p->a[7], 1);
 
-  return cf_new(bihom, p);
+  cf_t res = cf_new(bihom, p);
+  cf_add_input(res, x);
+  cf_add_input(res, y);
+  return res;
 }
 
 cf_t cf_new_div(cf_t x, cf_t y) {
@@ -280,5 +472,8 @@ cf_t cf_new_div(cf_t x, cf_t y) {
   mpz_set_si(p->a[1], 1);
   mpz_set_si(p->a[6], 1);
 
-  return cf_new(bihom, p);
+  cf_t res = cf_new(bihom, p);
+  cf_add_input(res, x);
+  cf_add_input(res, y);
+  return res;
 }
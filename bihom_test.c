@@ -50,6 +50,17 @@ int main() {
   cf_free(c1);
   cf_free(s1);
 
+  // Check 2 sin(1/3) cos(1/3) = sin(2/3), with both from one node.
+  cf_t sc[2];
+  cf_new_sincos_int(sc, 1, 3);
+  b = cf_new_bihom(sc[0], sc[1], a);
+
+  CF_EXPECT_DEC(b, "0.61836980306973700774");
+
+  cf_free(b);
+  cf_free(sc[0]);
+  cf_free(sc[1]);
+
   // Check 2 (cos 1)^2 - 1 = cos 2.
   c1 = cf_new_cos1();
   cf_t t[2];
@@ -2,12 +2,19 @@
 //
 // TODO: Handle messy thread problems. What happens if a thread quits
 // but then another tries to signal and read its channel?
-// TODO: What if the continued fraction terminates?
+#define _GNU_SOURCE  // For pthread_setaffinity_np() and CPU_SET().
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
 #include <gmp.h>
+#include "cf.h"
 
 struct channel_s {
   void *data;
@@ -16,6 +23,49 @@ struct channel_s {
 typedef struct channel_s channel_t[1];
 typedef struct channel_s *channel_ptr;
 
+// Shared by the outputs of a node with several output channels.
+struct multi_s {
+  int n, live;
+  struct cf_s **out;
+  pthread_mutex_t mu;
+};
+typedef struct multi_s *multi_ptr;
+
+// A source whose terms are given in closed form.
+struct indexed_s {
+  void (*term_at)(mpz_t z, unsigned long i, void *data);
+  void (*clear)(void *data);
+  void *data;
+  // Index of the next term to be read. The channel holds the terms just
+  // before it. Guarded by chan_mu.
+  unsigned long pos;
+  unsigned long n;  // Number of terms, or ULONG_MAX.
+  int cut;  // Whether the n terms are only the start of the expansion.
+};
+typedef struct indexed_s *indexed_ptr;
+
+// Bounds on a continued fraction from the terms output so far, published
+// with a seqlock so other threads can read them without blocking the node.
+// The writer holds chan_mu.
+struct snap_s {
+  // Convergents of the terms so far, and scratch space, private to the
+  // writer.
+  mpz_t p, pold, q, qold;
+  mpz_t f[4];
+  unsigned long n;  // Number of terms so far.
+  int bits;
+  // Published below. The sequence number is odd while they are written.
+  unsigned seq;
+  unsigned long terms;
+  int sign;
+  // Numerator and denominator of the lower then the upper bound, each with
+  // len[i] <= cap limbs.
+  size_t cap;
+  size_t len[4];
+  mp_limb_t *limb[4];
+};
+typedef struct snap_s *snap_ptr;
+
 struct cf_s {
   // Each continued fraction is a separate thread.
   pthread_t thread;
@@ -23,6 +73,9 @@ struct cf_s {
   // Rewrite with semaphores?
   // When queue is empty, and there is demand for the next term.
   sem_t demand_sem;
+  // Usually &demand_sem. The outputs of a multi-output node all use the
+  // semaphore of the first output, since one thread serves them all.
+  sem_t *demand;
   // When the queue was empty, and we just added to it.
   pthread_cond_t read_cond;
   pthread_mutex_t chan_mu;
@@ -36,9 +89,219 @@ struct cf_s {
   int sign;
   int quitflag;
   void *data;
+  multi_ptr multi;  // NULL unless there are several outputs.
+  indexed_ptr index;  // NULL unless terms can be computed directly.
+  snap_ptr snap;  // NULL unless cf_enable_snapshot() was called.
+  unsigned long bits;  // Precision wanted by readers. See cf_want_bits().
+  int popped;  // Whether any term has been read.
+  int ended;  // Whether the last term has been put. Guarded by chan_mu.
+  // Whether the terms ended short of the value, so that the last convergent
+  // is not exact. Terms put afterwards are dropped. Guarded by chan_mu.
+  int cut;
+  void *(*func)(cf_t);  // What the thread runs.
+  // Index of the CPU cluster the thread is pinned to, or -1. Only set on
+  // the first output of a multi-output node. See cf_set_affinity().
+  int cluster;
+  int inputs_placed;  // How many inputs the thread has placed.
+  // How long readers spin waiting for a term, and the thread spins waiting
+  // for demand, before sleeping. See cf_set_spin().
+  int spin_get, spin_wait;
+  int refs;  // Handles to cf, including those held by readers.
+  // Inputs, each holding a reference. Only on the first output of a
+  // multi-output node.
+  cf_t *input;
+  int ninput;
+  // The input the thread is blocked reading, if any, so that cf_free() can
+  // wake it. Guarded by wait_mu.
+  cf_t waiting_on;
+  pthread_mutex_t wait_mu;
 };
 
-typedef struct cf_s *cf_t;
+// Counters over all continued fractions, for benchmarks. See cf_stats().
+static unsigned long stat_nodes, stat_threads, stat_peak_threads, stat_terms;
+// Every writer would share the cache line of stat_terms, so it is counted
+// only when asked. See cf_set_stats().
+static int stats_on;
+
+void cf_set_stats(int on) {
+  __atomic_store_n(&stats_on, on, __ATOMIC_RELAXED);
+}
+
+void cf_stats(struct cf_stats_s *s) {
+  s->nodes = __atomic_load_n(&stat_nodes, __ATOMIC_RELAXED);
+  s->threads = __atomic_load_n(&stat_threads, __ATOMIC_RELAXED);
+  s->peak_threads = __atomic_load_n(&stat_peak_threads, __ATOMIC_RELAXED);
+  s->terms = __atomic_load_n(&stat_terms, __ATOMIC_RELAXED);
+}
+
+// Placement of threads on CPUs. See cf_set_affinity().
+static int place_on;
+static pthread_mutex_t place_mu = PTHREAD_MUTEX_INITIALIZER;
+static cpu_set_t *cluster;  // CPUs sharing an L2 cache, or a core.
+static int ncluster, next_cluster;
+static __thread cf_t place_self;  // The node this thread runs, if any.
+
+// Adds the CPUs in a list such as "0-3,8" from a sysfs file to set.
+// Returns 0 if the file cannot be read.
+static int read_cpu_list(cpu_set_t *set, const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) return 0;
+  int lo, hi, n = 0;
+  char c;
+  while (fscanf(fp, "%d", &lo) == 1) {
+    hi = lo;
+    if ((c = getc(fp)) == '-') {
+      if (fscanf(fp, "%d", &hi) != 1) break;
+      c = getc(fp);
+    }
+    for (int i = lo; i <= hi && i < CPU_SETSIZE; i++) CPU_SET(i, set), n++;
+    if (c != ',') break;
+  }
+  fclose(fp);
+  return n > 0;
+}
+
+// Groups the CPUs we may run on by L2 cache, or failing that by core.
+static void find_clusters(void) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed)) return;
+  cluster = malloc(sizeof(*cluster) * CPU_COUNT(&allowed));
+  char path[128];
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, &allowed)) continue;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    int found = 0;
+    for (int k = 0; !found && k < 8; k++) {
+      snprintf(path, sizeof(path),
+          "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, k);
+      FILE *fp = fopen(path, "r");
+      if (!fp) break;
+      int level = 0;
+      if (fscanf(fp, "%d", &level) != 1) level = 0;
+      fclose(fp);
+      if (level != 2) continue;
+      snprintf(path, sizeof(path),
+          "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+          cpu, k);
+      found = read_cpu_list(&set, path);
+    }
+    if (!found) {
+      snprintf(path, sizeof(path),
+          "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+      if (!read_cpu_list(&set, path)) CPU_SET(cpu, &set);
+    }
+    CPU_AND(&set, &set, &allowed);
+    int k = 0;
+    while (k < ncluster && !CPU_EQUAL(&set, &cluster[k])) k++;
+    if (k == ncluster) cluster[ncluster++] = set;
+  }
+}
+
+int cf_set_affinity(int on) {
+  pthread_mutex_lock(&place_mu);
+  if (on && !cluster) find_clusters();
+  int n = on ? ncluster : 0;
+  __atomic_store_n(&place_on, n > 0, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&place_mu);
+  return n;
+}
+
+// Called when this thread reads cf. The first input a node reads shares
+// its cluster, so a producer sits by its consumer. Further inputs, and
+// nodes read from other threads, start on the next cluster in turn, which
+// spreads independent subgraphs out.
+static void place(cf_t cf) {
+  if (cf->multi) cf = cf->multi->out[0];
+  if (__atomic_load_n(&cf->cluster, __ATOMIC_RELAXED) >= 0) return;
+  pthread_mutex_lock(&place_mu);
+  if (cf->cluster < 0) {
+    cf_t self = place_self;
+    int c;
+    if (self && self->cluster >= 0 && !self->inputs_placed++) {
+      c = self->cluster;
+    } else {
+      if (self) self->inputs_placed++;
+      c = next_cluster++ % ncluster;
+    }
+    pthread_setaffinity_np(cf->thread, sizeof(cpu_set_t), &cluster[c]);
+    __atomic_store_n(&cf->cluster, c, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&place_mu);
+}
+
+// Spinning before sleeping. See cf_set_spin().
+enum { SPIN_MIN = 16, SPIN_INIT = 1024, SPIN_MAX = 1 << 14 };
+static int spin_on;
+static pthread_once_t spin_once = PTHREAD_ONCE_INIT;
+
+// Spinning only wastes time if there is no other CPU to make progress.
+static void spin_init(void) {
+  spin_on = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+}
+
+void cf_set_spin(int on) {
+  pthread_once(&spin_once, spin_init);
+  __atomic_store_n(&spin_on, on, __ATOMIC_RELAXED);
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#else
+  __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+// A wait that ended after i of budget rounds of spinning, or never if
+// i = budget, sets the budget for the next: about twice the rounds it
+// took, or half as much as before if that was not enough.
+static int spin_adapt(int budget, int i) {
+  if (i == budget) return budget / 2 > SPIN_MIN ? budget / 2 : SPIN_MIN;
+  budget = (budget + 2 * i + SPIN_MIN) / 2;
+  return budget < SPIN_MAX ? budget : SPIN_MAX;
+}
+
+// Spins while the channel of cf is empty, for a while. Called without
+// chan_mu, so the reads are only a hint, checked again under the lock.
+static void spin_get(cf_t cf) {
+  int budget = cf->spin_get, i;
+  for (i = 0; i < budget; i++) {
+    if (__atomic_load_n(&cf->chan, __ATOMIC_ACQUIRE)
+        || __atomic_load_n(&cf->ended, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+    cpu_relax();
+  }
+  cf->spin_get = spin_adapt(budget, i);
+}
+
+// Tries to take the demand semaphore of cf for a while. Returns 1 if it
+// did.
+static int spin_demand(cf_t cf) {
+  int budget = cf->spin_wait, i;
+  for (i = 0; i < budget; i++) {
+    if (!sem_trywait(cf->demand)) break;
+    cpu_relax();
+  }
+  cf->spin_wait = spin_adapt(budget, i);
+  return i < budget;
+}
+
+// Sets the input the thread of self is blocked reading.
+static void set_waiting_on(cf_t self, cf_t cf) {
+  pthread_mutex_lock(&self->wait_mu);
+  self->waiting_on = cf;
+  pthread_mutex_unlock(&self->wait_mu);
+}
+
+// Whether the node self is being freed, so that reads by its thread should
+// give up. Outputs of a multi-output node are freed one by one, but share
+// the thread, which stops when they are all gone.
+static int quitting(cf_t self) {
+  if (self->multi) return !__atomic_load_n(&self->multi->live, __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&self->quitflag, __ATOMIC_SEQ_CST);
+}
 
 void *cf_data(cf_t cf) {
   return cf->data;
@@ -56,12 +319,26 @@ int cf_flip_sign(cf_t cf) {
   return cf->sign = -cf->sign;
 }
 
+// Readers may tell a continued fraction how many bits of precision they
+// will want, so it can plan ahead. The hint only ever grows.
+void cf_want_bits(cf_t cf, unsigned long bits) {
+  unsigned long old = __atomic_load_n(&cf->bits, __ATOMIC_RELAXED);
+  while (old < bits && !__atomic_compare_exchange_n(&cf->bits, &old, bits,
+      1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+unsigned long cf_bits(cf_t cf) {
+  return __atomic_load_n(&cf->bits, __ATOMIC_RELAXED);
+}
+
 // A bit like cooperative multitasking. Continued fractions are expected
 // to call this as often as practical, and on a return value of 0,
 // to drop everything and stop.
 int cf_wait(cf_t cf) {
   for (;;) {
-    sem_wait(&cf->demand_sem);
+    if (!(__atomic_load_n(&spin_on, __ATOMIC_RELAXED) && spin_demand(cf))) {
+      sem_wait(cf->demand);
+    }
     // The wait is over!
     if (cf->quitflag) {
       return 0;
@@ -77,12 +354,52 @@ int cf_wait(cf_t cf) {
   return 1;
 }
 
-void cf_free(cf_t cf) {
-  // These two statements force a thread out of its next/current cf_wait.
-  cf->quitflag = 1;
-  sem_post(&cf->demand_sem);
+// Like cf_wait(), but for the thread of a multi-output node, which is
+// passed its first output. Returns a bitmask of outputs with empty channels
+// once there is demand on one of them, or 0 when all have been freed.
+int cf_wait_multi(cf_t cf) {
+  multi_ptr m = cf->multi;
+  for (;;) {
+    sem_wait(cf->demand);
+    int mask = 0, live = 0;
+    for (int k = 0; k < m->n; k++) {
+      cf_t out = m->out[k];
+      if (out->quitflag) continue;
+      live++;
+      pthread_mutex_lock(&out->chan_mu);
+      if (!out->chan) mask |= 1 << k;
+      pthread_mutex_unlock(&out->chan_mu);
+    }
+    if (!live) return 0;
+    if (mask) return mask;
+  }
+}
+
+cf_t cf_output(cf_t cf, int k) {
+  return cf->multi->out[k];
+}
+
+int cf_output_live(cf_t cf, int k) {
+  return !__atomic_load_n(&cf->multi->out[k]->quitflag, __ATOMIC_RELAXED);
+}
+
+// The node whose thread serves cf, and which holds its inputs.
+static cf_t owner(cf_t cf) {
+  return cf->multi ? cf->multi->out[0] : cf;
+}
+
+cf_t cf_ref(cf_t cf) {
+  __atomic_add_fetch(&cf->refs, 1, __ATOMIC_RELAXED);
+  return cf;
+}
 
-  pthread_join(cf->thread, NULL);
+void cf_add_input(cf_t cf, cf_t x) {
+  cf = owner(cf);
+  cf->input = realloc(cf->input, sizeof(*cf->input) * (cf->ninput + 1));
+  cf->input[cf->ninput++] = cf_ref(x);
+}
+
+static void cf_destroy(cf_t cf) {
   pthread_mutex_lock(&cf->chan_mu);
   channel_ptr c = cf->chan;
   while (c) {
@@ -93,11 +410,123 @@ void cf_free(cf_t cf) {
     c = cnext;
   }
   pthread_mutex_unlock(&cf->chan_mu);
+  snap_ptr sn = cf->snap;
+  if (sn) {
+    mpz_clear(sn->p); mpz_clear(sn->pold);
+    mpz_clear(sn->q); mpz_clear(sn->qold);
+    for (int i = 0; i < 4; i++) {
+      mpz_clear(sn->f[i]);
+      free(sn->limb[i]);
+    }
+    free(sn);
+  }
   sem_destroy(&cf->demand_sem);
   free(cf);
 }
 
-void cf_put(cf_t cf, mpz_t z) {
+void cf_free(cf_t cf) {
+  if (__atomic_sub_fetch(&cf->refs, 1, __ATOMIC_ACQ_REL)) return;
+  // These two statements force a thread out of its next/current cf_wait.
+  __atomic_store_n(&cf->quitflag, 1, __ATOMIC_SEQ_CST);
+  sem_post(cf->demand);
+
+  multi_ptr m = cf->multi;
+  if (m) {
+    // The outputs of a multi-output node share a thread, which keeps
+    // running until they have all been freed.
+    pthread_mutex_lock(&m->mu);
+    int live = __atomic_sub_fetch(&m->live, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&m->mu);
+    if (live) return;
+  }
+  // ... and this forces it out of a cf_get() on an input.
+  cf_t self = owner(cf);
+  pthread_mutex_lock(&self->wait_mu);
+  cf_t w = self->waiting_on;
+  if (w) {
+    pthread_mutex_lock(&w->chan_mu);
+    pthread_cond_broadcast(&w->read_cond);
+    pthread_mutex_unlock(&w->chan_mu);
+  }
+  pthread_mutex_unlock(&self->wait_mu);
+  pthread_join(self->thread, NULL);
+  for (int i = 0; i < self->ninput; i++) cf_free(self->input[i]);
+  free(self->input);
+  if (!m) {
+    cf_destroy(cf);
+    return;
+  }
+  for (int k = m->n - 1; k >= 0; k--) cf_destroy(m->out[k]);
+  pthread_mutex_destroy(&m->mu);
+  free(m->out);
+  free(m);
+}
+
+void cf_free_graph(cf_t cf) {
+  // Find every node first, as freeing one may free others.
+  int n = 0, cap = 16;
+  cf_t *node = malloc(sizeof(*node) * cap);
+  void add(cf_t x) {
+    for (int i = 0; i < n; i++) if (node[i] == x) return;
+    if (n == cap) node = realloc(node, sizeof(*node) * (cap *= 2));
+    node[n++] = x;
+  }
+  add(cf);
+  for (int i = 0; i < n; i++) {
+    multi_ptr m = node[i]->multi;
+    if (m) for (int k = 0; k < m->n; k++) add(m->out[k]);
+    cf_t self = owner(node[i]);
+    for (int j = 0; j < self->ninput; j++) add(self->input[j]);
+  }
+  for (int i = 0; i < n; i++) cf_free(node[i]);
+  free(node);
+}
+
+// Takes the next term z. The continued fraction lies between p/q and
+// (p + pold)/(q + qold), which we round outwards to about sn->bits bits, and
+// publish unless they are still too big.
+static void snap_update(snap_ptr sn, mpz_t z, int sign) {
+  mpz_addmul(sn->pold, z, sn->p);
+  mpz_swap(sn->pold, sn->p);
+  mpz_addmul(sn->qold, z, sn->q);
+  mpz_swap(sn->qold, sn->q);
+  sn->n++;
+
+  // After an odd number of terms, p/q is the lower bound.
+  int odd = sn->n & 1;
+  mpz_t *f = sn->f;
+  mpz_set(f[2 * !odd], sn->p);
+  mpz_set(f[2 * !odd + 1], sn->q);
+  mpz_add(f[2 * odd], sn->p, sn->pold);
+  mpz_add(f[2 * odd + 1], sn->q, sn->qold);
+  for (int i = 0; i < 4; i += 2) {
+    size_t n = mpz_sizeinbase(f[i], 2), d = mpz_sizeinbase(f[i + 1], 2);
+    size_t m = n < d ? n : d;
+    if (m <= (size_t) sn->bits) continue;
+    mp_bitcnt_t e = m - sn->bits;
+    if (!i) {
+      mpz_fdiv_q_2exp(f[i], f[i], e);
+      mpz_cdiv_q_2exp(f[i + 1], f[i + 1], e);
+    } else {
+      mpz_cdiv_q_2exp(f[i], f[i], e);
+      mpz_fdiv_q_2exp(f[i + 1], f[i + 1], e);
+    }
+  }
+  for (int i = 0; i < 4; i++) if (mpz_size(f[i]) > sn->cap) return;
+
+  unsigned seq = sn->seq;
+  __atomic_store_n(&sn->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  for (int i = 0; i < 4; i++) {
+    mpz_export(sn->limb[i], &sn->len[i], -1, sizeof(mp_limb_t), 0, 0, f[i]);
+  }
+  sn->terms = sn->n;
+  sn->sign = sign;
+  __atomic_store_n(&sn->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// Appends z to the channel. Requires chan_mu.
+static void chan_push(cf_t cf, mpz_t z) {
   // TODO: Block or something if there's a large backlog on the queue.
   channel_ptr cnew = malloc(sizeof(*cnew));
   mpz_ptr znew = malloc(sizeof(*znew));
@@ -105,7 +534,6 @@ void cf_put(cf_t cf, mpz_t z) {
   mpz_set(znew, z);
   cnew->data = znew;
   cnew->next = NULL;
-  pthread_mutex_lock(&cf->chan_mu);
   if (cf->chan) {
     cf->next->next = cnew;
   } else {
@@ -115,6 +543,27 @@ void cf_put(cf_t cf, mpz_t z) {
     pthread_cond_signal(&cf->read_cond);
   }
   cf->next = cnew;
+  if (cf->snap) snap_update(cf->snap, z, cf->sign);
+  if (__atomic_load_n(&stats_on, __ATOMIC_RELAXED)) {
+    __atomic_add_fetch(&stat_terms, 1, __ATOMIC_RELAXED);
+  }
+}
+
+// Removes the first term in the channel and puts it in z. Requires chan_mu.
+static void chan_pop(mpz_t z, cf_t cf) {
+  cf->popped = 1;
+  channel_ptr c = cf->chan;
+  cf->chan = c->next;
+  mpz_ptr znew = c->data;
+  mpz_set(z, znew);
+  mpz_clear(znew);
+  free(c->data);
+  free(c);
+}
+
+void cf_put(cf_t cf, mpz_t z) {
+  pthread_mutex_lock(&cf->chan_mu);
+  if (!cf->cut) chan_push(cf, z);
   pthread_mutex_unlock(&cf->chan_mu);
 }
 
@@ -126,44 +575,397 @@ void cf_put_int(cf_t cf, int n) {
   mpz_clear(z);
 }
 
-void cf_signal(cf_t cf) {
-  sem_post(&cf->demand_sem);
+// Marks the end of a finite continued fraction, such as that of a rational.
+// Readers get the terms already put, and then cf_get() returns 0. The
+// thread may then return without waiting to be freed.
+void cf_put_end(cf_t cf) {
+  pthread_mutex_lock(&cf->chan_mu);
+  cf->ended = 1;
+  pthread_cond_broadcast(&cf->read_cond);
+  pthread_mutex_unlock(&cf->chan_mu);
+}
+
+// Like cf_put_end(), but the terms stop short of the value, as when a file
+// of terms was cut short.
+void cf_put_cut(cf_t cf) {
+  pthread_mutex_lock(&cf->chan_mu);
+  cf->ended = 1;
+  cf->cut = 1;
+  pthread_cond_broadcast(&cf->read_cond);
+  pthread_mutex_unlock(&cf->chan_mu);
+}
+
+int cf_cut(cf_t cf) {
+  if (cf->index && cf->index->cut) return 1;
+  pthread_mutex_lock(&cf->chan_mu);
+  int res = cf->cut;
+  pthread_mutex_unlock(&cf->chan_mu);
+  return res;
 }
-void cf_wait_special(cf_t cf) {
-  sem_wait(&cf->demand_sem);
+
+// Called when the node self reads past the end of an input that was cut
+// short. Whatever it would output next depends on the missing terms, so
+// its output is cut short too. The outputs of a multi-output node may
+// still owe terms already computed, so such nodes check cf_cut() on their
+// inputs themselves, and cut each output once it runs out.
+static void cut_self(cf_t self) {
+  if (!self->multi) cf_put_cut(self);
 }
 
-void cf_get(mpz_t z, cf_t cf) {
+// Outputs the terms of p/q >= 0 by Euclid's algorithm, one per demand,
+// starting with one that is already due, and then ends cf. Leaves p and q
+// alone. For q = 0, there are no more terms.
+void cf_put_rational(cf_t cf, mpz_t p, mpz_t q) {
+  mpz_t a, b, t;
+  mpz_init(a); mpz_init(b); mpz_init(t);
+  mpz_set(a, p);
+  mpz_set(b, q);
+  while (mpz_sgn(b)) {
+    mpz_fdiv_qr(t, a, a, b);
+    mpz_swap(a, b);
+    cf_put(cf, t);
+    if (!mpz_sgn(b) || !cf_wait(cf)) break;
+  }
+  cf_put_end(cf);
+  mpz_clear(a); mpz_clear(b); mpz_clear(t);
+}
+
+
+int cf_get(mpz_t z, cf_t cf) {
+  // A node being freed gives up reading, wherever it is.
+  cf_t self = place_self;
+  if (self && quitting(self)) return 0;
+  if (__atomic_load_n(&place_on, __ATOMIC_RELAXED)) place(cf);
   pthread_mutex_lock(&cf->chan_mu);
-  if (!cf->chan) {
+  if (!cf->chan && !cf->ended) {
     // If channel is empty, send demand signal and wait for read signal.
-    sem_post(&cf->demand_sem);
-    pthread_cond_wait(&cf->read_cond, &cf->chan_mu);
+    sem_post(cf->demand);
+    pthread_mutex_unlock(&cf->chan_mu);
+    // Cheap producers answer sooner than we could sleep and wake.
+    if (__atomic_load_n(&spin_on, __ATOMIC_RELAXED)) spin_get(cf);
+    if (self) set_waiting_on(self, cf);
+    pthread_mutex_lock(&cf->chan_mu);
+    while (!cf->chan && !cf->ended && !(self && quitting(self))) {
+      pthread_cond_wait(&cf->read_cond, &cf->chan_mu);
+    }
+    if (self) {
+      pthread_mutex_unlock(&cf->chan_mu);
+      set_waiting_on(self, NULL);
+      pthread_mutex_lock(&cf->chan_mu);
+    }
   }
-  channel_ptr c = cf->chan;
-  cf->chan = c->next;
+  if (!cf->chan || (self && quitting(self))) {
+    int cut = !cf->chan && cf->cut;
+    pthread_mutex_unlock(&cf->chan_mu);
+    if (cut && self) cut_self(self);
+    return 0;
+  }
+  chan_pop(z, cf);
   pthread_mutex_unlock(&cf->chan_mu);
-  mpz_ptr znew = c->data;
-  mpz_set(z, znew);
-  mpz_clear(znew);
-  free(c->data);
-  free(c);
+  return 1;
 }
 
-cf_t cf_new(void *(*func)(cf_t), void *data) {
+// Like cf_get(), but gives up and returns 0 at the given deadline, measured
+// against CLOCK_REALTIME. The term is still computed, and is returned by
+// the next read.
+int cf_get_timed(mpz_t z, cf_t cf, const struct timespec *deadline) {
+  if (place_self && quitting(place_self)) return 0;
+  if (__atomic_load_n(&place_on, __ATOMIC_RELAXED)) place(cf);
+  pthread_mutex_lock(&cf->chan_mu);
+  if (!cf->chan && !cf->ended) {
+    sem_post(cf->demand);
+    while (!cf->chan && !cf->ended) {
+      if (pthread_cond_timedwait(&cf->read_cond, &cf->chan_mu, deadline)
+          == ETIMEDOUT) {
+        pthread_mutex_unlock(&cf->chan_mu);
+        return 0;
+      }
+    }
+  }
+  if (!cf->chan) {
+    int cut = cf->cut;
+    pthread_mutex_unlock(&cf->chan_mu);
+    if (cut && place_self) cut_self(place_self);
+    return 0;
+  }
+  chan_pop(z, cf);
+  pthread_mutex_unlock(&cf->chan_mu);
+  return 1;
+}
+
+// Puts back terms read from cf, in front of any still in its channel.
+void cf_unget(cf_t cf, mpz_t *z, int n) {
+  if (!n) return;
+  channel_ptr first = NULL, last = NULL;
+  for (int k = 0; k < n; k++) {
+    channel_ptr c = malloc(sizeof(*c));
+    mpz_ptr znew = malloc(sizeof(*znew));
+    mpz_init_set(znew, z[k]);
+    c->data = znew;
+    c->next = NULL;
+    if (last) last->next = c;
+    else first = c;
+    last = c;
+  }
+  pthread_mutex_lock(&cf->chan_mu);
+  last->next = cf->chan;
+  if (!cf->chan) cf->next = last;
+  cf->chan = first;
+  pthread_mutex_unlock(&cf->chan_mu);
+}
+
+// Starts publishing bounds for cf from the terms it outputs, as numerators
+// and denominators of about the given number of bits. Returns 0 if some
+// terms have already been read, as they are no longer available.
+int cf_enable_snapshot(cf_t cf, int bits) {
+  pthread_mutex_lock(&cf->chan_mu);
+  if (cf->popped || cf->snap) {
+    pthread_mutex_unlock(&cf->chan_mu);
+    return cf->snap != NULL;
+  }
+  snap_ptr sn = malloc(sizeof(*sn));
+  mpz_init(sn->p); mpz_init(sn->pold);
+  mpz_init(sn->q); mpz_init(sn->qold);
+  mpz_set_ui(sn->p, 1);
+  mpz_set_ui(sn->qold, 1);
+  sn->n = 0;
+  sn->bits = bits;
+  sn->seq = 0;
+  sn->terms = 0;
+  sn->sign = 1;
+  // Rounding outwards leaves at least bits bits in the smaller of the
+  // numerator and denominator, and the bigger might be a few limbs longer.
+  sn->cap = bits / GMP_NUMB_BITS + 4;
+  for (int i = 0; i < 4; i++) {
+    mpz_init(sn->f[i]);
+    sn->len[i] = 0;
+    sn->limb[i] = malloc(sizeof(mp_limb_t) * sn->cap);
+  }
+  // Catch up on terms waiting in the channel.
+  for (channel_ptr c = cf->chan; c; c = c->next) {
+    snap_update(sn, c->data, cf->sign);
+  }
+  cf->snap = sn;
+  pthread_mutex_unlock(&cf->chan_mu);
+  return 1;
+}
+
+// Sets lo <= x <= hi from the latest bounds published by cf, without
+// waiting for it, and returns how many terms they come from. Returns 0 and
+// leaves lo and hi alone if there are none yet.
+unsigned long cf_snapshot(cf_t cf, mpq_t lo, mpq_t hi) {
+  snap_ptr sn = cf->snap;
+  if (!sn) return 0;
+  mp_limb_t limb[4][sn->cap];
+  size_t len[4];
+  unsigned long terms;
+  int sign;
+  unsigned seq;
+  do {
+    seq = __atomic_load_n(&sn->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) continue;
+    terms = sn->terms;
+    sign = sn->sign;
+    for (int i = 0; i < 4; i++) {
+      len[i] = sn->len[i];
+      if (len[i] > sn->cap) len[i] = sn->cap;
+      memcpy(limb[i], sn->limb[i], sizeof(mp_limb_t) * len[i]);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (seq & 1 || __atomic_load_n(&sn->seq, __ATOMIC_RELAXED) != seq);
+  if (!terms) return 0;
+  mpz_import(mpq_numref(lo), len[0], -1, sizeof(mp_limb_t), 0, 0, limb[0]);
+  mpz_import(mpq_denref(lo), len[1], -1, sizeof(mp_limb_t), 0, 0, limb[1]);
+  mpz_import(mpq_numref(hi), len[2], -1, sizeof(mp_limb_t), 0, 0, limb[2]);
+  mpz_import(mpq_denref(hi), len[3], -1, sizeof(mp_limb_t), 0, 0, limb[3]);
+  mpq_canonicalize(lo);
+  mpq_canonicalize(hi);
+  if (sign < 0) {
+    mpq_neg(lo, lo);
+    mpq_neg(hi, hi);
+    mpq_swap(lo, hi);
+  }
+  return terms;
+}
+
+// Reads the next n terms, or as many as are left, and returns how many.
+// Indexed sources compute those not already in the channel directly in the
+// calling thread, bypassing the channel.
+int cf_get_block(mpz_t *z, cf_t cf, int n) {
+  indexed_ptr ix = cf->index;
+  // Bypassing the channel would also bypass snapshots.
+  if (!ix || cf->snap) {
+    for (int k = 0; k < n; k++) if (!cf_get(z[k], cf)) return k;
+    return n;
+  }
+  if (place_self && quitting(place_self)) return 0;
+  if (__atomic_load_n(&place_on, __ATOMIC_RELAXED)) place(cf);
+  int k = 0;
+  pthread_mutex_lock(&cf->chan_mu);
+  while (k < n && cf->chan) chan_pop(z[k++], cf);
+  cf->popped = 1;
+  unsigned long i = ix->pos;
+  if ((unsigned long) (n - k) > ix->n - i) {
+    n = k + (ix->n - i);
+    if (ix->cut && place_self) {
+      pthread_mutex_unlock(&cf->chan_mu);
+      cut_self(place_self);
+      pthread_mutex_lock(&cf->chan_mu);
+    }
+  }
+  ix->pos += n - k;
+  pthread_mutex_unlock(&cf->chan_mu);
+  for (; k < n; k++) ix->term_at(z[k], i++, ix->data);
+  return n;
+}
+
+// Sets z to term i of an indexed source, counting from 0, regardless of
+// how many terms have been read. Returns 0 if cf is not indexed, or has no
+// term i.
+int cf_term_at(mpz_t z, cf_t cf, unsigned long i) {
+  indexed_ptr ix = cf->index;
+  if (!ix || i >= ix->n) return 0;
+  ix->term_at(z, i, ix->data);
+  return 1;
+}
+
+static cf_t cf_alloc(void *data) {
   cf_t cf = malloc(sizeof(*cf));
   cf->sign = 1;
   cf->chan = NULL;
   cf->next = NULL;
   cf->quitflag = 0;
   cf->data = data;
-  pthread_attr_t attr;
-  pthread_attr_init(&attr);
-  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  cf->multi = NULL;
+  cf->index = NULL;
+  cf->snap = NULL;
+  cf->bits = 0;
+  cf->popped = 0;
+  cf->ended = 0;
+  cf->cut = 0;
+  cf->cluster = -1;
+  cf->inputs_placed = 0;
+  cf->spin_get = cf->spin_wait = SPIN_INIT;
+  cf->refs = 1;
+  cf->input = NULL;
+  cf->ninput = 0;
+  cf->waiting_on = NULL;
+  pthread_mutex_init(&cf->wait_mu, NULL);
+  pthread_once(&spin_once, spin_init);
   pthread_mutex_init(&cf->chan_mu, NULL);
   sem_init(&cf->demand_sem, 0, 0);
+  cf->demand = &cf->demand_sem;
   pthread_cond_init(&cf->read_cond, NULL);
-  pthread_create(&cf->thread, &attr, (void*(*)(void *)) func, cf);
+  return cf;
+}
+
+static void *cf_run(void *data) {
+  cf_t cf = data;
+  place_self = cf;
+  void *res = cf->func(cf);
+  __atomic_sub_fetch(&stat_threads, 1, __ATOMIC_RELAXED);
+  return res;
+}
+
+static void cf_start(cf_t cf, void *(*func)(cf_t)) {
+  __atomic_add_fetch(&stat_nodes, 1, __ATOMIC_RELAXED);
+  unsigned long n = __atomic_add_fetch(&stat_threads, 1, __ATOMIC_RELAXED);
+  unsigned long peak = __atomic_load_n(&stat_peak_threads, __ATOMIC_RELAXED);
+  while (peak < n && !__atomic_compare_exchange_n(&stat_peak_threads, &peak,
+      n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  cf->func = func;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  pthread_create(&cf->thread, &attr, cf_run, cf);
   pthread_attr_destroy(&attr);
+}
+
+cf_t cf_new(void *(*func)(cf_t), void *data) {
+  cf_t cf = cf_alloc(data);
+  cf_start(cf, func);
   return cf;
 }
+
+// Start one thread serving n output channels, written to out[].
+// The thread is passed out[0].
+void cf_new_multi(cf_t *out, int n, void *(*func)(cf_t), void *data) {
+  assert(n > 0 && n <= 31);  // So that the mask of cf_wait_multi() fits.
+  multi_ptr m = malloc(sizeof(*m));
+  m->n = n;
+  m->live = n;
+  m->out = malloc(sizeof(*m->out) * n);
+  pthread_mutex_init(&m->mu, NULL);
+  for (int k = 0; k < n; k++) {
+    out[k] = m->out[k] = cf_alloc(data);
+    out[k]->multi = m;
+    out[k]->demand = &out[0]->demand_sem;
+  }
+  cf_start(out[0], func);
+}
+
+static void *indexed_source(cf_t cf) {
+  indexed_ptr ix = cf->index;
+  mpz_t z;
+  mpz_init(z);
+  while(cf_wait(cf)) {
+    pthread_mutex_lock(&cf->chan_mu);
+    unsigned long i = ix->pos;
+    pthread_mutex_unlock(&cf->chan_mu);
+    // Readers may still want random access, so we stay until freed.
+    if (i >= ix->n) {
+      if (ix->cut) cf_put_cut(cf);
+      else cf_put_end(cf);
+      continue;
+    }
+    ix->term_at(z, i, ix->data);
+    pthread_mutex_lock(&cf->chan_mu);
+    // Drop the term if cf_get_block() took it meanwhile.
+    if (ix->pos == i) {
+      ix->pos++;
+      chan_push(cf, z);
+    }
+    pthread_mutex_unlock(&cf->chan_mu);
+  }
+  mpz_clear(z);
+  if (ix->clear) ix->clear(ix->data);
+  free(ix);
+  return NULL;
+}
+
+// A source with n terms, where term_at(z, i, data) sets z to term i. It
+// may be called from several threads at once. If cut is set, the terms are
+// only the start of the expansion.
+static cf_t new_indexed(void (*term_at)(mpz_t z, unsigned long i,
+    void *data), void (*clear)(void *data), void *data, unsigned long n,
+    int sign, int cut) {
+  indexed_ptr ix = malloc(sizeof(*ix));
+  ix->term_at = term_at;
+  ix->clear = clear;
+  ix->data = data;
+  ix->pos = 0;
+  ix->n = n;
+  ix->cut = cut;
+  cf_t cf = cf_alloc(data);
+  cf->index = ix;
+  cf->sign = sign;
+  cf_start(cf, indexed_source);
+  return cf;
+}
+
+cf_t cf_new_indexed_finite(void (*term_at)(mpz_t z, unsigned long i,
+    void *data), void (*clear)(void *data), void *data, unsigned long n,
+    int sign) {
+  return new_indexed(term_at, clear, data, n, sign, 0);
+}
+
+cf_t cf_new_indexed_cut(void (*term_at)(mpz_t z, unsigned long i,
+    void *data), void (*clear)(void *data), void *data, unsigned long n,
+    int sign) {
+  return new_indexed(term_at, clear, data, n, sign, 1);
+}
+
+cf_t cf_new_indexed(void (*term_at)(mpz_t z, unsigned long i, void *data),
+    void (*clear)(void *data), void *data) {
+  return new_indexed(term_at, clear, data, ULONG_MAX, 1, 0);
+}
@@ -1,4 +1,4 @@
-// Requires gmp.h
+// Requires stdio.h and gmp.h
 //
 // Opaque interface to continued fractions object.
 
@@ -12,24 +12,138 @@ cf_t cf_new(void *(*func)(cf_t), void *data);
 static inline cf_t cf_new_const(void *(*func)(cf_t)) {
   return cf_new(func, NULL);
 }
+// Drops a handle to cf. Once none are left, stops its thread, even in the
+// middle of reading an input, where cf_get() returns 0, and then drops its
+// handles to its inputs.
 void cf_free(cf_t cf);
+// Another handle to cf, for another reader. Returns cf.
+cf_t cf_ref(cf_t cf);
+// Makes cf hold a handle to x until cf is freed. Constructors call this for
+// each input, so that freeing a node frees any inputs nobody else reads.
+void cf_add_input(cf_t cf, cf_t x);
+// Frees cf and every node it reads from, directly or not, as if cf_free()
+// were called once on each: for a graph whose intermediate nodes the caller
+// never freed. Nodes still read from elsewhere live on until those readers
+// are freed.
+void cf_free_graph(cf_t cf);
 
 void cf_set_sign(cf_t cf, int sign);
 int cf_sign(cf_t cf);
 int cf_flip_sign(cf_t cf);
-void cf_get(mpz_t z, cf_t cf);
+// Returns 0, leaving z alone, once a finite continued fraction has ended.
+int cf_get(mpz_t z, cf_t cf);
+// Puts back n terms that the caller read from cf, so that the next reads
+// return z[0], ..., z[n - 1] again. Only the reader of cf may call this.
+void cf_unget(cf_t cf, mpz_t *z, int n);
 void cf_put(cf_t cf, mpz_t z);
 void cf_put_int(cf_t cf, int n);
+// Ends a finite continued fraction.
+void cf_put_end(cf_t cf);
+// Outputs the terms of p/q >= 0, one per demand, then ends cf.
+void cf_put_rational(cf_t cf, mpz_t p, mpz_t q);
+// Ends cf short of its value, such as at the end of a file that was cut
+// short. Readers see the end as for cf_put_end(). A node that reads past it
+// cannot know the rest of its own output either, so its output ends the
+// same way, and terms it puts afterwards are dropped. Multi-output nodes
+// instead check cf_cut() and cut each output themselves.
+void cf_put_cut(cf_t cf);
+// Whether the terms of cf stop short of its value, so that after cf_get()
+// returns 0 the last convergent is not exact.
+int cf_cut(cf_t cf);
 
 int cf_wait(cf_t cf);
 
 void *cf_data(cf_t cf);
 
-void cf_signal(cf_t cf); // For tee.
-void cf_wait_special(cf_t cf);
+// Sources with terms in closed form: term_at(z, i, data) sets z to term i,
+// and may be called from several threads at once. Such sources can also be
+// read many terms at a time without channel traffic, and randomly accessed.
+cf_t cf_new_indexed(void (*term_at)(mpz_t z, unsigned long i, void *data),
+    void (*clear)(void *data), void *data);
+// The same for a continued fraction with the given sign and n terms.
+cf_t cf_new_indexed_finite(void (*term_at)(mpz_t z, unsigned long i,
+    void *data), void (*clear)(void *data), void *data, unsigned long n,
+    int sign);
+// The same for the first n terms of a longer expansion, which ends with
+// cf_put_cut().
+cf_t cf_new_indexed_cut(void (*term_at)(mpz_t z, unsigned long i,
+    void *data), void (*clear)(void *data), void *data, unsigned long n,
+    int sign);
+// Reads the next n terms of any continued fraction, or as many as are left,
+// and returns how many.
+int cf_get_block(mpz_t *z, cf_t cf, int n);
+// Sets z to term i of an indexed source and returns 1, or returns 0 if
+// cf is not indexed or has no term i.
+int cf_term_at(mpz_t z, cf_t cf, unsigned long i);
 
-// From cf_tee.c:
-//
+// Precision hints: readers may say how many bits they will want, so nodes
+// can plan ahead, and pass the hint on to their inputs.
+void cf_want_bits(cf_t cf, unsigned long bits);
+unsigned long cf_bits(cf_t cf);
+
+// Reading under time limits. Deadlines are absolute, for CLOCK_REALTIME.
+struct timespec;
+// Like cf_get(), but returns 0 if the next term is not ready by the
+// deadline. It is then returned by the next read instead.
+int cf_get_timed(mpz_t z, cf_t cf, const struct timespec *deadline);
+// Makes cf publish bounds from the terms it outputs, with numerators and
+// denominators of about the given number of bits, which any thread can then
+// read with cf_snapshot() without waiting. Returns 0 if terms of cf have
+// already been read. Reading an indexed source this way gives up the
+// shortcuts of cf_get_block().
+int cf_enable_snapshot(cf_t cf, int bits);
+// Sets lo <= x <= hi from the latest published bounds, and returns the
+// number of terms they are based on, or 0 if there are none yet.
+unsigned long cf_snapshot(cf_t cf, mpq_t lo, mpq_t hi);
+
+// Nodes with several output channels served by one thread, which is passed
+// out[0]. It calls cf_wait_multi() instead of cf_wait(), and reaches the
+// other outputs with cf_output(). Free every output; the thread stops when
+// the last one is freed. There may be at most 31 outputs, as
+// cf_wait_multi() returns a bit mask of those wanting a term.
+void cf_new_multi(cf_t *out, int n, void *(*func)(cf_t), void *data);
+int cf_wait_multi(cf_t cf);
+cf_t cf_output(cf_t cf, int k);
+// Whether output k has not been freed.
+int cf_output_live(cf_t cf, int k);
+
+// Counters over all continued fractions since the program started.
+struct cf_stats_s {
+  unsigned long nodes;  // Threads started.
+  unsigned long threads, peak_threads;  // Threads running, now and at most.
+  unsigned long terms;  // Terms put on channels while counting is on.
+};
+void cf_stats(struct cf_stats_s *s);
+// Whether cf_stats() counts terms, which costs every node a shared counter
+// update per term. Off by default.
+void cf_set_stats(int on);
+
+// Pins node threads to CPUs as they are first read from, if on: a node
+// shares a core or L2 cache with the first input it reads, and other inputs
+// go to the next cluster in turn. Returns the number of clusters, or 0 if
+// placement is off or unsupported. Off by default.
+int cf_set_affinity(int on);
+
+// Whether waits for a term or for demand spin briefly before sleeping. The
+// spin adapts to how long each channel usually takes. On by default when
+// there is more than one CPU; turn it off on oversubscribed machines.
+void cf_set_spin(int on);
+
+// Nodes keep their state in machine words while it fits, and fall back to
+// mpz_t on overflow. Sets r = a b + c, and returns 0 if it overflows.
+static inline int cf_word_muladd(long *r, long a, long b, long c) {
+  long t;
+  return !__builtin_mul_overflow(a, b, &t) && !__builtin_add_overflow(t, c, r);
+}
+// Sets r = z and returns 1 if z is nonnegative and fits in a long.
+static inline int cf_word_get(long *r, mpz_t z) {
+  if (!mpz_fits_slong_p(z) || mpz_sgn(z) < 0) return 0;
+  *r = mpz_get_si(z);
+  return 1;
+}
+
+// From tee.c:
+// Two outputs with the terms of in, which each may read at its own pace.
 void cf_tee(cf_t *out_array, cf_t in);
 
 // From cf_mobius.c:
@@ -58,6 +172,9 @@ cf_t cf_new_nonregular_mobius_to_decimal(cf_t x, mpz_t a[4]);
 
 cf_t cf_new_const_nonregular(void *(*fun)(cf_t));
 cf_t cf_new_one_arg_nonregular(void *(*fun)(cf_t), mpz_t z);
+cf_t cf_new_indexed_nonregular(
+    void (*term_at)(mpz_t z, unsigned long i, void *data),
+    void (*clear)(void *data), void *data);
 
 // Well-known continued fraction expansions.
 // cf_famous.c:
@@ -69,6 +186,10 @@ cf_t cf_new_pi();
 cf_t cf_new_tan1();
 cf_t cf_new_epow(mpz_t pow);
 cf_t cf_new_tanh(mpz_t z);
+// From series with cf_new_series().
+cf_t cf_new_log2();
+cf_t cf_new_zeta3();
+cf_t cf_new_catalan();
 
 // This won't work because my code cannot handle negative denominators,
 // and also assumes the sequence of convergents alternatively overshoot
@@ -93,9 +214,131 @@ void mpz8_set_sub(mpz_t z[8]);
 void mpz8_set_mul(mpz_t z[8]);
 void mpz8_set_div(mpz_t z[8]);
 
+// From series.c:
+// Sums of series: for i = 0, ..., m - 1, output i is the sum over k >= 0 of
+//
+//   a_i(k)/b_i(k) prod_{j = 0}^{k} p(j)/q(j)
+//
+// where term(p, q, a, b, k, data) sets p(k), q(k) and the weights a[i], b[i]
+// at k, with q(k), b[i] > 0. After summing k < n, tail(bound, t, n, data) is given
+// the absolute value t of the first omitted term of one of the sums, not
+// necessarily in lowest terms, and sets bound to at least the absolute value
+// of the rest of that sum, or returns 0 if it cannot yet. The sums must be
+// nonzero. If clear is not NULL, clear(data) is called when the node stops.
+// As for cf_new_multi(), m is at most 31.
+void cf_new_series_multi(cf_t *out, int m,
+    void (*term)(mpz_t p, mpz_t q, mpz_t *a, mpz_t *b, unsigned long k,
+        void *data),
+    int (*tail)(mpq_t bound, mpq_t t, unsigned long n, void *data),
+    void (*clear)(void *data), void *data);
+cf_t cf_new_series(
+    void (*term)(mpz_t p, mpz_t q, mpz_t *a, mpz_t *b, unsigned long k,
+        void *data),
+    int (*tail)(mpq_t bound, mpq_t t, unsigned long n, void *data),
+    void (*clear)(void *data), void *data);
+int cf_series_tail_alternating(mpq_t bound, mpq_t t, unsigned long n,
+    void *data);
+// A nonzero number known only through bounds: each call of
+// refine(r0, r1, data) sets r0 <= x <= r1, tighter than the last call and
+// converging to x. The bounds need not be in lowest terms, but must have
+// positive denominators.
+cf_t cf_new_bracketed(void (*refine)(mpq_t r0, mpq_t r1, void *data),
+    void (*clear)(void *data), void *data);
+
+// From convergent.c:
+// Decimal expansion of x truncated to n digits after the point, such as
+// "-0.1147", computed from many terms at once. If buf is NULL, the result
+// is allocated with malloc(). Returns NULL if x was cut short before the
+// digits were settled.
+char *cf_to_decimal_bulk(cf_t x, int n, char *buf);
+// Prints x to n digits after the point to fp, in groups of 5 and lines of
+// 50, as the programs here do. From 10000 digits it uses
+// cf_to_decimal_bulk(), so nothing appears until the end.
+void cf_print_decimal(FILE *fp, cf_t x, int n);
+// p/q = the convergent formed by the next n > 0 terms of x, from a product
+// tree of the terms' matrices computed by several threads. Returns the
+// number of terms used, which is less than n if x ends first.
+int cf_convergent_at(cf_t x, int n, mpz_t p, mpz_t q);
+// Like cf_new_mobius_convergent() and cf_new_cf_convergent(), but output
+// only every kth convergent.
+cf_t cf_new_mobius_convergent_stride(cf_t x, mpz_t a, mpz_t b, mpz_t c,
+    mpz_t d, int k);
+cf_t cf_new_cf_convergent_stride(cf_t x, int k);
+// Sets out to a convergent of x within 2^-bits of x, reading terms only
+// until they guarantee this, and returns how many it read. Returns 0 if x
+// was cut short first, leaving out at its last convergent.
+unsigned long cf_eval_to_bits(cf_t x, unsigned long bits, mpq_t out);
+// Reads terms of x until the deadline, and sets lo <= x <= hi from them.
+// Returns the number of terms read; if 0, lo and hi are left alone.
+unsigned long cf_approx_by_deadline(cf_t x, const struct timespec *deadline,
+    mpq_t lo, mpq_t hi);
+// p/q = the closest fraction to x with 0 < q <= maxden, taking the one
+// with the smaller q on a tie, for maxden >= 1. Reads terms only until the
+// next convergent's denominator would pass maxden, and rarely a few more
+// to break a tie between the last convergent and a semiconvergent.
+// Returns 0, with p/q the last convergent, if x was cut short before the
+// answer was settled.
+int cf_best_approx(cf_t x, mpz_t maxden, mpz_t p, mpz_t q);
+
+// From convert.c:
+// x correctly rounded to nearest, reading only as many terms as it takes,
+// or NaN if x was cut short before the rounding was settled.
+double cf_get_d(cf_t x);
+// x truncated to the precision of f. Returns 0, leaving f alone, if x was
+// cut short before the truncation was settled.
+int cf_get_mpf(mpf_t f, cf_t x);
+// Finite continued fractions of rationals, and of a double, exactly.
+cf_t cf_new_from_mpq(mpq_t q);
+cf_t cf_new_from_double(double d);
+// Reads a decimal number such as "-12.345" from fp, a digit at a time as
+// terms are wanted, and stops at the first character that does not belong.
+cf_t cf_new_from_decimal_stream(FILE *fp);
+#ifdef MPFR_VERSION
+// x rounded to the precision of f in the given direction. Returns the sign
+// of f - x, as MPFR functions do, or sets f to NaN and returns 0 if x was
+// cut short before the rounding was settled. Needs a build with
+// -DHAVE_MPFR.
+int cf_get_mpfr(mpfr_t f, cf_t x, mpfr_rnd_t rnd);
+#endif
+
+// From arena.c:
+// Has GMP allocate from size classes cached per thread, instead of with
+// malloc(). Call before any GMP variable is initialized, as memory from one
+// allocator cannot be freed by the other. If hugepages, allocations of 2MB
+// or more are mapped on their own and backed by huge pages where the kernel
+// allows.
+void cf_arena_init(int hugepages);
+
+// From termfile.c:
+// Writes the first n terms of x, or all of them if it ends first, to a
+// file, and returns 0 on error.
+int cf_write_file(const char *path, cf_t x, unsigned long n);
+// An indexed source serving the terms in a file from cf_write_file(). It
+// ends after the last term in the file, cut short as for cf_put_cut() if
+// the file does not hold the whole expansion. Returns NULL if the file
+// cannot be read.
+cf_t cf_new_from_file(const char *path);
+// Passes on the terms of x unchanged, and records those it passes on in a
+// file for cf_new_from_file(), which is complete once the recorder is
+// freed. Replaying the file feeds a node the same input with no upstream
+// threads. Returns NULL if the file cannot be opened.
+cf_t cf_new_recorder(cf_t x, const char *path);
+
+// From chudnovsky.c:
+// pi from the Chudnovsky series, summed in parallel.
+cf_t cf_new_pi_chudnovsky();
+
 // From taylor.c:
+// sin(p/q) and cos(p/q) for nonzero p.
+cf_t cf_new_sin(mpz_t p, mpz_t q);
+cf_t cf_new_cos(mpz_t p, mpz_t q);
+cf_t cf_new_sin_int(int a, int b);
+cf_t cf_new_cos_int(int a, int b);
 cf_t cf_new_sin1();
 cf_t cf_new_cos1();
+// out[0] = sin(p/q), out[1] = cos(p/q), sharing one series evaluation.
+void cf_new_sincos(cf_t out[2], mpz_t p, mpz_t q);
+void cf_new_sincos_int(cf_t out[2], int a, int b);
 
 // From newton.c:
 // Use Newton's method to find solutions of:
@@ -108,4 +351,55 @@ cf_t cf_new_sqrt(cf_t x);
 cf_t cf_new_sqrt_int(int a, int b);
 cf_t cf_new_sqrt_pq(mpz_t zp, mpz_t zq);
 
+// From algebraic.c:
+// Real root number k, counting from 0 in increasing order, of
+//
+//     poly[0] + poly[1] x + ... + poly[n] x^n
+//
+// Returns NULL if there are not that many real roots. Rational roots have
+// finite expansions.
+cf_t cf_new_algebraic(mpz_t *poly, int n, int k);
+
+// From parse.c:
+// Builds the graph for an expression such as
+//
+//   sqrt(3/pi^2+e)/(tanh(sqrt(5))-sin(69))
+//
+// with + - * / ^, numbers such as 42 and 0.5, the constants pi, e, log2,
+// zeta3 and catalan, and the functions sqrt, sin, cos, tanh and exp.
+// Exponents must be integers, and sin, cos, tanh and exp need rational
+// arguments: integers for tanh and exp, apart from tanh(sqrt(k)).
+// Repeated subexpressions are computed once and tee'd, and arithmetic with
+// numbers folds into Mobius and bihom nodes. Returns NULL if the
+// expression cannot be parsed or is not supported. cf_free() on the result
+// frees the whole graph.
+cf_t cf_parse(const char *s);
+
+// From compare.c:
+// These read terms only until they know the answer, and then put them back
+// with cf_unget(), so x and y can still be read in full afterwards. Like
+// other nodes, they never return if the answer hinges on an exact value,
+// such as an integer, that x and y never end at. If x or y was cut short
+// before the answer was settled, they report failure.
+// -1, 0 or 1 as x < y, x = y or x > y, or 2 on failure.
+int cf_cmp(cf_t x, cf_t y);
+// z = the largest integer <= x. Returns 0 on failure.
+int cf_floor(mpz_t z, cf_t x);
+// -1, 0 or 1 as x < 0, x = 0 or x > 0, or 2 on failure.
+int cf_sign_of(cf_t x);
+
+// From batch.c:
+// Sets out[i] to the decimal expansion of
+//
+//   (z[i][0] sqrt(k[i]) + z[i][1]) / (z[i][2] sqrt(k[i]) + z[i][3])
+//
+// truncated to n digits after the point, as from cf_to_decimal_bulk(), for
+// each of the lanes. One thread computes them all, in words until they
+// overflow. out[i] is NULL if the denominator is zero or k[i] >= 2^62.
+// Free each string with free().
+void cf_batch_mobius_sqrt(char **out, unsigned long (*z)[4],
+    unsigned long *k, int lanes, int n);
+// Likewise for sqrt(k[i]).
+void cf_batch_sqrt(char **out, unsigned long *k, int lanes, int n);
+
 #endif  // __CF_H__
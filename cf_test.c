@@ -1,7 +1,9 @@
 // Test demand channel infrastructure.
 
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <gmp.h>
 #include "cf.h"
 #include "test.h"
@@ -27,6 +29,89 @@ static void *count_int_fn(cf_t cf) {
   return NULL;
 }
 
+// Output k counts up in steps of k + 1.
+static void *multi_count_fn(cf_t cf) {
+  mpz_t z[2];
+  mpz_init(z[0]);
+  mpz_init(z[1]);
+  int mask;
+  while((mask = cf_wait_multi(cf))) {
+    for (int k = 0; k < 2; k++) if (mask & (1 << k)) {
+      cf_put(cf_output(cf, k), z[k]);
+      mpz_add_ui(z[k], z[k], k + 1);
+    }
+  }
+  mpz_clear(z[0]);
+  mpz_clear(z[1]);
+  return NULL;
+}
+
+// Counts up, but takes 100ms per term.
+static void *slow_count_fn(cf_t cf) {
+  struct timespec ts = { 0, 100000000 };
+  int n = 0;
+  while(cf_wait(cf)) {
+    nanosleep(&ts, NULL);
+    cf_put_int(cf, n);
+    n++;
+  }
+  return NULL;
+}
+
+static void *sqrt2_fn(cf_t cf) {
+  cf_put_int(cf, 1);
+  while(cf_wait(cf)) {
+    cf_put_int(cf, 2);
+  }
+  return NULL;
+}
+
+static void *neg_sqrt2_fn(cf_t cf) {
+  cf_set_sign(cf, -1);
+  return sqrt2_fn(cf);
+}
+
+// Sets ts to ms milliseconds from now.
+static void from_now(struct timespec *ts, long ms) {
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_sec += ms / 1000;
+  ts->tv_nsec += ms % 1000 * 1000000;
+  if (ts->tv_nsec >= 1000000000) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+// Whether lo < sqrt(2) < hi, or -sqrt(2) if sign is negative.
+static int brackets_sqrt2(mpq_t lo, mpq_t hi, int sign) {
+  mpq_t t;
+  mpq_init(t);
+  int ok = sign * mpq_sgn(lo) > 0 && sign * mpq_sgn(hi) > 0;
+  mpq_mul(t, lo, lo);
+  ok = ok && mpq_cmp_ui(t, 2, 1) * sign < 0;
+  mpq_mul(t, hi, hi);
+  ok = ok && mpq_cmp_ui(t, 2, 1) * sign > 0;
+  mpq_clear(t);
+  return ok;
+}
+
+static void square_fn(mpz_t z, unsigned long i, void *data) {
+  mpz_set_ui(z, i);
+  mpz_mul(z, z, z);
+}
+
+// Never outputs anything.
+static void *silent_fn(cf_t cf) {
+  while(cf_wait(cf));
+  return NULL;
+}
+
+static unsigned long threads() {
+  struct cf_stats_s st;
+  cf_stats(&st);
+  return st.threads;
+}
+
 int main() {
   mpz_t z, z1;
   mpz_init(z);
@@ -42,6 +127,156 @@ int main() {
   }
   cf_free(a);
   cf_free(b);
+
+  // Two outputs from one thread. Keep reading one after freeing the other.
+  cf_t m[2];
+  cf_new_multi(m, 2, multi_count_fn, NULL);
+  for (int i = 0; i < 50; i++) {
+    cf_get(z, m[1]);
+    EXPECT(!mpz_cmp_ui(z, 2 * i));
+    if (i % 3) continue;
+    cf_get(z, m[0]);
+    EXPECT(!mpz_cmp_ui(z, i / 3));
+  }
+  cf_free(m[0]);
+  for (int i = 50; i < 100; i++) {
+    cf_get(z, m[1]);
+    EXPECT(!mpz_cmp_ui(z, 2 * i));
+  }
+  cf_free(m[1]);
+
+  // Mix reads from the channel with block reads of an indexed source.
+  a = cf_new_indexed(square_fn, NULL, NULL);
+  mpz_t blk[10];
+  for (int i = 0; i < 10; i++) mpz_init(blk[i]);
+  int n = 0;
+  for (int i = 0; i < 20; i++) {
+    cf_get(z, a);
+    EXPECT(!mpz_cmp_ui(z, n * n));
+    n++;
+    cf_get_block(blk, a, 1 + i % 10);
+    for (int k = 0; k <= i % 10; k++, n++) {
+      EXPECT(!mpz_cmp_ui(blk[k], n * n));
+    }
+  }
+  EXPECT(cf_term_at(z, a, 1000) && !mpz_cmp_ui(z, 1000000));
+  cf_get(z, a);
+  EXPECT(!mpz_cmp_ui(z, n * n));
+  cf_free(a);
+  // Block reads from other continued fractions go through the channel.
+  b = cf_new_const(count_int_fn);
+  EXPECT(!cf_term_at(z, b, 0));
+  cf_get_block(blk, b, 10);
+  for (int k = 0; k < 10; k++) EXPECT(!mpz_cmp_ui(blk[k], k));
+  cf_free(b);
+  for (int i = 0; i < 10; i++) mpz_clear(blk[i]);
+
+  // Timed reads give up, but the term is not lost.
+  struct timespec deadline;
+  a = cf_new_const(slow_count_fn);
+  from_now(&deadline, 10);
+  EXPECT(!cf_get_timed(z, a, &deadline));
+  cf_get(z, a);
+  EXPECT(!mpz_cmp_ui(z, 0));
+  from_now(&deadline, 10000);
+  EXPECT(cf_get_timed(z, a, &deadline) && !mpz_cmp_ui(z, 1));
+  cf_free(a);
+
+  mpq_t lo, hi, eps;
+  mpq_init(lo);
+  mpq_init(hi);
+  mpq_init(eps);
+  a = cf_new_const(neg_sqrt2_fn);
+  from_now(&deadline, 10);
+  EXPECT(cf_approx_by_deadline(a, &deadline, lo, hi) >= 2);
+  EXPECT(brackets_sqrt2(lo, hi, -1));
+  cf_free(a);
+
+  // Snapshots of bounds while another thread reads terms.
+  a = cf_new_const(sqrt2_fn);
+  EXPECT(cf_enable_snapshot(a, 64));
+  for (int i = 0; i < 100; i++) cf_get(z, a);
+  EXPECT(cf_snapshot(a, lo, hi) >= 100);
+  EXPECT(brackets_sqrt2(lo, hi, 1));
+  // 64 bits are plenty for 10 digits.
+  mpq_sub(lo, hi, lo);
+  mpz_ui_pow_ui(z, 10, 10);
+  mpq_set_z(eps, z);
+  mpq_inv(eps, eps);
+  EXPECT(mpq_cmp(lo, eps) < 0);
+  cf_free(a);
+  // Bounds the right way round after each of the first few terms, while
+  // they are exact.
+  for (int k = 1; k <= 6; k++) {
+    a = cf_new_const(sqrt2_fn);
+    EXPECT(cf_enable_snapshot(a, 1024));
+    for (int i = 0; i < k; i++) cf_get(z, a);
+    EXPECT(cf_snapshot(a, lo, hi) >= k);
+    EXPECT(brackets_sqrt2(lo, hi, 1));
+    cf_free(a);
+  }
+  // Too late once terms have been read.
+  a = cf_new_const(neg_sqrt2_fn);
+  cf_get(z, a);
+  EXPECT(!cf_enable_snapshot(a, 64));
+  EXPECT(!cf_snapshot(a, lo, hi));
+  cf_free(a);
+
+  // Inputs outlive their handles while a reader needs them.
+  unsigned long nthread = threads();
+  a = cf_new_const(sqrt2_fn);
+  b = cf_new_cf_to_decimal(a);
+  cf_free(a);
+  for (int i = 0; i < 7; i++) cf_get(z, b);
+  EXPECT(!mpz_cmp_ui(z, 3));  // 1.414213
+  cf_free(b);
+  EXPECT(threads() == nthread);
+
+  // Tearing down a graph with shared nodes, after reading from it.
+  cf_t t[2];
+  cf_tee(t, cf_new_const(sqrt2_fn));
+  a = cf_new_add(t[0], t[1]);
+  CF_EXPECT_DEC(a, "2.82842");
+  cf_free_graph(a);
+  EXPECT(threads() == nthread);
+
+  // Freeing a node blocked inside a read of an input that never comes.
+  a = cf_new_add(cf_new_const(silent_fn), cf_new_const(sqrt2_fn));
+  from_now(&deadline, 10);
+  EXPECT(!cf_get_timed(z, a, &deadline));
+  cf_free_graph(a);
+  EXPECT(threads() == nthread);
+
+  // Pinned threads give the same terms.
+  EXPECT(cf_set_affinity(1) > 0);
+  a = cf_new_const(sqrt2_fn);
+  b = cf_new_const(count_fn);
+  for (int i = 0; i < 100; i++) {
+    EXPECT(cf_get(z, a) && !mpz_cmp_ui(z, i ? 2 : 1));
+    EXPECT(cf_get(z, b) && !mpz_cmp_ui(z, i));
+  }
+  cf_free(b);
+  cf_free(a);
+  EXPECT(!cf_set_affinity(0));
+
+  // So do spinning waits, including for a term that ends the expansion.
+  cf_set_spin(1);
+  a = cf_new_const(count_fn);
+  for (int i = 0; i < 1000; i++) EXPECT(cf_get(z, a) && !mpz_cmp_ui(z, i));
+  cf_free(a);
+  mpq_t q;
+  mpq_init(q);
+  mpq_set_ui(q, 7, 2);
+  a = cf_new_from_mpq(q);
+  mpq_clear(q);
+  EXPECT(cf_get(z, a) && !mpz_cmp_ui(z, 3));
+  EXPECT(cf_get(z, a) && !mpz_cmp_ui(z, 2));
+  EXPECT(!cf_get(z, a));
+  cf_free(a);
+  cf_set_spin(0);
+  mpq_clear(eps);
+  mpq_clear(lo);
+  mpq_clear(hi);
   mpz_clear(z);
   mpz_clear(z1);
   return 0;
@@ -0,0 +1,182 @@
+// Continued fraction of pi from the Chudnovsky series:
+//
+//   1/pi = 12 sum_{k >= 0} (-1)^k (6k)! (A + B k)
+//                          / ((3k)! (k!)^3 C^(3k + 3/2))
+//
+// where A = 13591409, B = 545140134, C = 640320. Writing S for the sum of
+// (A + B k) prod_{j = 1}^{k} p(j)/q(j), with
+//
+//   p(j) = -(6j - 5)(2j - 1)(6j - 1),  q(j) = j^3 C^3 / 24,
+//
+// we have pi = 426880 sqrt(10005) / S. Each term adds about 14 digits. The
+// series alternates with decreasing terms, so consecutive partial sums
+// bracket S. Together with bounds on sqrt(10005) from an integer square
+// root, these give rational bounds on pi, which we tighten by doubling the
+// number of terms. Binary splitting subtrees run in parallel threads.
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <gmp.h>
+#include "cf.h"
+
+static const unsigned long chud_a = 13591409;
+static const unsigned long chud_b = 545140134;
+static const unsigned long chud_c3_24 = 10939058860032000UL;  // C^3 / 24
+
+// Binary splitting results for k in [lo, hi): P, Q are the products of
+// p(k), q(k), and T / Q is the sum of (A + B k) prod_{j = lo}^{k} p(j)/q(j).
+struct chud_s {
+  mpz_t P, Q, T;
+  unsigned long lo, hi;
+  int threads;  // How many threads we may use.
+};
+typedef struct chud_s chud_t[1];
+typedef struct chud_s *chud_ptr;
+
+static void chud_init(chud_ptr c) {
+  mpz_init(c->P); mpz_init(c->Q); mpz_init(c->T);
+}
+
+static void chud_clear(chud_ptr c) {
+  mpz_clear(c->P); mpz_clear(c->Q); mpz_clear(c->T);
+}
+
+static void chud_pq(mpz_t p, mpz_t q, unsigned long k) {
+  if (!k) {
+    mpz_set_ui(p, 1);
+    mpz_set_ui(q, 1);
+    return;
+  }
+  mpz_set_ui(p, 6 * k - 5);
+  mpz_mul_ui(p, p, 2 * k - 1);
+  mpz_mul_ui(p, p, 6 * k - 1);
+  mpz_neg(p, p);
+  mpz_set_ui(q, k);
+  mpz_mul_ui(q, q, k);
+  mpz_mul_ui(q, q, k);
+  mpz_mul_ui(q, q, chud_c3_24);
+}
+
+// Appends c2 to c, destroying c2: T = T1 Q2 + P1 T2.
+static void chud_merge(chud_ptr c, chud_ptr c2) {
+  mpz_mul(c->T, c->T, c2->Q);
+  mpz_mul(c2->T, c2->T, c->P);
+  mpz_add(c->T, c->T, c2->T);
+  mpz_mul(c->P, c->P, c2->P);
+  mpz_mul(c->Q, c->Q, c2->Q);
+  c->hi = c2->hi;
+}
+
+static void *chud_split(void *data) {
+  chud_ptr c = data;
+  unsigned long lo = c->lo, hi = c->hi;
+  if (hi - lo == 1) {
+    chud_pq(c->P, c->Q, lo);
+    mpz_set_ui(c->T, chud_b);
+    mpz_mul_ui(c->T, c->T, lo);
+    mpz_add_ui(c->T, c->T, chud_a);
+    mpz_mul(c->T, c->T, c->P);
+    return NULL;
+  }
+  unsigned long mid = lo + (hi - lo) / 2;
+  chud_t c2;
+  chud_init(c2);
+  c2->lo = mid;
+  c2->hi = hi;
+  c->hi = mid;
+  // Small ranges are not worth a thread.
+  if (c->threads > 1 && hi - lo >= 16) {
+    pthread_t thread;
+    c2->threads = c->threads / 2;
+    c->threads -= c2->threads;
+    pthread_create(&thread, NULL, chud_split, c2);
+    chud_split(c);
+    pthread_join(thread, NULL);
+    c->threads += c2->threads;
+  } else {
+    c2->threads = 1;
+    chud_split(c);
+    chud_split(c2);
+  }
+  chud_merge(c, c2);
+  chud_clear(c2);
+  return NULL;
+}
+
+struct pi_chud_s {
+  chud_t sum;  // For k in [0, n).
+  unsigned long n;
+  mpz_t t0, t1, t2, t3;
+};
+typedef struct pi_chud_s *pi_chud_ptr;
+
+static void pi_chud_refine(mpq_t r0, mpq_t r1, void *data) {
+  pi_chud_ptr pc = data;
+  chud_ptr c = pc->sum;
+  unsigned long n = pc->n;
+
+  // Sum k in [n, 2n), or [0, 1) to start.
+  if (!n) {
+    c->lo = 0;
+    c->hi = 1;
+    chud_split(c);
+    n = 1;
+  } else {
+    chud_t c2;
+    chud_init(c2);
+    c2->lo = n;
+    c2->hi = 2 * n;
+    c2->threads = c->threads;
+    chud_split(c2);
+    chud_merge(c, c2);
+    chud_clear(c2);
+    n *= 2;
+  }
+  pc->n = n;
+
+  // Consecutive partial sums over the common denominator D = Q q(n):
+  // S_n = T q(n) / D and S_(n+1) = (T q(n) + a(n) P p(n)) / D.
+  mpz_ptr p = pc->t0, q = pc->t1, lo = pc->t2, hi = pc->t3;
+  chud_pq(p, q, n);
+  mpz_mul(lo, c->T, q);
+  mpz_mul(p, p, c->P);
+  mpz_mul_ui(p, p, chud_a + chud_b * n);
+  mpz_add(hi, lo, p);
+  if (mpz_cmp(lo, hi) > 0) mpz_swap(lo, hi);
+  mpz_mul(q, q, c->Q);
+
+  // pi = 426880 sqrt(10005) D / (D S), and
+  //   s / 2^e <= sqrt(10005) < (s + 1) / 2^e
+  // for s = floor(sqrt(10005 4^e)). About 47 bits per term suffice.
+  mp_bitcnt_t e = 48 * n + 64;
+  mpz_set_ui(mpq_numref(r0), 10005);
+  mpz_mul_2exp(mpq_numref(r0), mpq_numref(r0), 2 * e);
+  mpz_sqrt(mpq_numref(r0), mpq_numref(r0));
+  mpz_add_ui(mpq_numref(r1), mpq_numref(r0), 1);
+  mpz_mul(mpq_numref(r0), mpq_numref(r0), q);
+  mpz_mul(mpq_numref(r1), mpq_numref(r1), q);
+  mpz_mul_ui(mpq_numref(r0), mpq_numref(r0), 426880);
+  mpz_mul_ui(mpq_numref(r1), mpq_numref(r1), 426880);
+  mpz_mul_2exp(mpq_denref(r0), hi, e);
+  mpz_mul_2exp(mpq_denref(r1), lo, e);
+}
+
+static void pi_chud_clear(void *data) {
+  pi_chud_ptr pc = data;
+  chud_clear(pc->sum);
+  mpz_clear(pc->t0); mpz_clear(pc->t1);
+  mpz_clear(pc->t2); mpz_clear(pc->t3);
+  free(pc);
+}
+
+cf_t cf_new_pi_chudnovsky() {
+  pi_chud_ptr pc = malloc(sizeof(*pc));
+  chud_init(pc->sum);
+  pc->sum->threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (pc->sum->threads < 1) pc->sum->threads = 1;
+  pc->n = 0;
+  mpz_init(pc->t0); mpz_init(pc->t1);
+  mpz_init(pc->t2); mpz_init(pc->t3);
+  return cf_new_bracketed(pi_chud_refine, pi_chud_clear, pc);
+}
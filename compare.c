@@ -0,0 +1,198 @@
+// Comparisons that read only as many terms as they need.
+//
+// After terms a_0, ..., a_k of |x|, it lies between p_k/q_k and
+// (p_k + p_{k-1})/(q_k + q_{k-1}), or is p_k/q_k if x has ended. We read
+// terms until these brackets settle the question, and then put them back
+// with cf_unget(), so the inputs read the same afterwards. If x was cut
+// short, its last bracket is all we get, and may not settle it.
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include "cf.h"
+
+// Terms read so far from one input, and the bracket they give.
+struct peek_s {
+  cf_t x;
+  int sign;
+  int ended;
+  int cut;  // Whether it ended short of its value, so lo < hi still.
+  mpz_t *term;
+  int n, max;
+  mpz_t p, pold, q, qold;
+  mpq_t lo, hi;
+};
+typedef struct peek_s peek_t[1];
+typedef struct peek_s *peek_ptr;
+
+static void peek_init(peek_ptr r, cf_t x) {
+  r->x = x;
+  r->sign = 1;
+  r->ended = 0;
+  r->cut = 0;
+  r->n = 0;
+  r->max = 16;
+  r->term = malloc(sizeof(*r->term) * r->max);
+  mpz_init_set_ui(r->p, 1);
+  mpz_init(r->pold);
+  mpz_init(r->q);
+  mpz_init_set_ui(r->qold, 1);
+  mpq_init(r->lo);
+  mpq_init(r->hi);
+}
+
+// Puts the terms back.
+static void peek_clear(peek_ptr r) {
+  cf_unget(r->x, r->term, r->n);
+  for (int i = 0; i < r->n; i++) mpz_clear(r->term[i]);
+  free(r->term);
+  mpz_clear(r->p);
+  mpz_clear(r->pold);
+  mpz_clear(r->q);
+  mpz_clear(r->qold);
+  mpq_clear(r->lo);
+  mpq_clear(r->hi);
+}
+
+// Reads a term, and updates lo and hi.
+static void peek_read(peek_ptr r) {
+  if (r->n == r->max) {
+    r->term = realloc(r->term, sizeof(*r->term) * (r->max *= 2));
+  }
+  mpz_ptr a = r->term[r->n];
+  mpz_init(a);
+  if (!cf_get(a, r->x)) {
+    mpz_clear(a);
+    r->ended = 1;
+    r->cut = cf_cut(r->x);
+  } else {
+    if (!r->n++) r->sign = cf_sign(r->x);
+    mpz_swap(r->pold, r->p);
+    mpz_addmul(r->p, a, r->pold);
+    mpz_swap(r->qold, r->q);
+    mpz_addmul(r->q, a, r->qold);
+  }
+  if (!r->n) {
+    // No terms at all: take it as 0.
+    mpq_set_ui(r->lo, 0, 1);
+    mpq_set_ui(r->hi, 0, 1);
+    return;
+  }
+  mpz_set(mpq_numref(r->lo), r->p);
+  mpz_set(mpq_denref(r->lo), r->q);
+  mpq_canonicalize(r->lo);
+  if (r->ended && !r->cut) {
+    mpq_set(r->hi, r->lo);
+  } else {
+    mpz_add(mpq_numref(r->hi), r->p, r->pold);
+    mpz_add(mpq_denref(r->hi), r->q, r->qold);
+    mpq_canonicalize(r->hi);
+  }
+  if (r->sign < 0) {
+    mpq_neg(r->lo, r->lo);
+    mpq_neg(r->hi, r->hi);
+  }
+  if (mpq_cmp(r->lo, r->hi) > 0) mpq_swap(r->lo, r->hi);
+}
+
+// Whether the bracket of r is at least as wide as that of s, whose widths
+// are 1 / (q_k (q_k + q_{k-1})).
+static int peek_wider(peek_ptr r, peek_ptr s) {
+  if (r->ended) return 0;
+  if (s->ended) return 1;
+  mpz_t u, v;
+  mpz_init(u);
+  mpz_init(v);
+  mpz_add(u, r->q, r->qold);
+  mpz_mul(u, u, r->q);
+  mpz_add(v, s->q, s->qold);
+  mpz_mul(v, v, s->q);
+  int res = mpz_cmp(u, v) <= 0;
+  mpz_clear(u);
+  mpz_clear(v);
+  return res;
+}
+
+// Whether r was cut short with s inside its bracket, or before any terms,
+// so that neither can settle how they compare.
+static int peek_within(peek_ptr r, peek_ptr s) {
+  return r->cut && (!r->n ||
+      (mpq_cmp(s->lo, r->lo) >= 0 && mpq_cmp(s->hi, r->hi) <= 0));
+}
+
+int cf_cmp(cf_t x, cf_t y) {
+  if (x == y) return 0;
+  peek_t r, s;
+  peek_init(r, x);
+  peek_init(s, y);
+  peek_read(r);
+  peek_read(s);
+  int res;
+  for (;;) {
+    if (peek_within(r, s) || peek_within(s, r)) {
+      res = 2;
+      break;
+    }
+    if (mpq_cmp(r->hi, s->lo) < 0) {
+      res = -1;
+      break;
+    }
+    if (mpq_cmp(r->lo, s->hi) > 0) {
+      res = 1;
+      break;
+    }
+    if (r->ended && s->ended) {
+      res = mpq_cmp(r->lo, s->lo);
+      res = r->cut || s->cut ? 2 : (res > 0) - (res < 0);
+      break;
+    }
+    // Narrow the wider bracket.
+    peek_read(peek_wider(r, s) ? r : s);
+  }
+  peek_clear(r);
+  peek_clear(s);
+  return res;
+}
+
+int cf_floor(mpz_t z, cf_t x) {
+  peek_t r;
+  peek_init(r, x);
+  mpz_t f;
+  mpz_init(f);
+  int res = 1;
+  for (;;) {
+    peek_read(r);
+    mpz_fdiv_q(z, mpq_numref(r->lo), mpq_denref(r->lo));
+    mpz_fdiv_q(f, mpq_numref(r->hi), mpq_denref(r->hi));
+    if (!mpz_cmp(z, f) && !(r->cut && !r->n)) break;
+    if (r->ended) {
+      res = 0;
+      break;
+    }
+  }
+  mpz_clear(f);
+  peek_clear(r);
+  return res;
+}
+
+int cf_sign_of(cf_t x) {
+  peek_t r;
+  peek_init(r, x);
+  int res;
+  for (;;) {
+    peek_read(r);
+    if (mpq_sgn(r->lo) > 0) {
+      res = 1;
+      break;
+    }
+    if (mpq_sgn(r->hi) < 0) {
+      res = -1;
+      break;
+    }
+    if (r->ended) {
+      res = r->cut ? 2 : 0;
+      break;
+    }
+  }
+  peek_clear(r);
+  return res;
+}
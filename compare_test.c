@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "cf.h"
+#include "test.h"
+
+static cf_t rational(long p, long q) {
+  mpq_t r;
+  mpq_init(r);
+  mpq_set_si(r, p, q);
+  mpq_canonicalize(r);
+  cf_t x = cf_new_from_mpq(r);
+  mpq_clear(r);
+  return x;
+}
+
+static void expect_cmp(cf_t x, cf_t y, int want) {
+  EXPECT(cf_cmp(x, y) == want);
+  EXPECT(cf_cmp(y, x) == -want);
+  cf_free(x);
+  cf_free(y);
+}
+
+static void expect_floor(cf_t x, long want) {
+  mpz_t z;
+  mpz_init(z);
+  cf_floor(z, x);
+  EXPECT(!mpz_cmp_si(z, want));
+  mpz_clear(z);
+  cf_free(x);
+}
+
+static void expect_sign(cf_t x, int want) {
+  EXPECT(cf_sign_of(x) == want);
+  cf_free(x);
+}
+
+int main() {
+  // The inputs read the same afterwards.
+  cf_t pi = cf_new_pi(), e = cf_new_e();
+  EXPECT(cf_cmp(pi, e) == 1);
+  EXPECT(cf_cmp(e, pi) == -1);
+  EXPECT(cf_cmp(pi, pi) == 0);
+  EXPECT(cf_sign_of(pi) == 1);
+  mpz_t z;
+  mpz_init(z);
+  cf_floor(z, e);
+  EXPECT(!mpz_cmp_ui(z, 2));
+  CF_EXPECT_DEC(pi, "3.14159265358979323846");
+  CF_EXPECT_DEC(e, "2.71828182845904523536");
+  cf_free(pi);
+  cf_free(e);
+
+  expect_cmp(rational(7, 3), rational(14, 6), 0);
+  expect_cmp(rational(7, 3), rational(23333, 10000), 1);
+  expect_cmp(rational(-1, 2), rational(1, 3), -1);
+  expect_cmp(rational(-1, 2), rational(-1, 3), -1);
+  expect_cmp(rational(0, 1), rational(-1, 1000), 1);
+  expect_cmp(cf_new_sqrt_int(2, 1), rational(99, 70), -1);
+  expect_cmp(cf_new_sqrt_int(2, 1), rational(140, 99), 1);
+  expect_cmp(cf_new_sqrt_int(2, 1), rational(1393, 985), 1);
+  expect_cmp(cf_parse("-pi"), cf_parse("-e"), -1);
+
+  expect_floor(cf_new_pi(), 3);
+  expect_floor(cf_parse("-pi"), -4);
+  expect_floor(cf_parse("pi*e"), 8);
+  expect_floor(rational(7, 3), 2);
+  expect_floor(rational(-7, 3), -3);
+  expect_floor(rational(-2, 1), -2);
+  expect_floor(rational(5, 1), 5);
+  expect_floor(cf_parse("-sin(1/100)"), -1);
+
+  expect_sign(rational(-1, 7), -1);
+  expect_sign(rational(0, 1), 0);
+  expect_sign(cf_new_sin_int(69, 1), -1);
+  expect_sign(cf_parse("tanh(sqrt(5)) - sin(69)"), 1);
+  expect_sign(cf_parse("e - pi"), -1);
+
+  mpz_clear(z);
+  return 0;
+}
@@ -0,0 +1,511 @@
+// Convergents and decimal expansions from many terms at once.
+//
+// The recurrence for convergents costs O(N^2) for N-bit convergents. We
+// instead multiply out the matrices [a 1; 1 0] of a run of terms in a
+// balanced product tree, which takes advantage of fast multiplication, and
+// let GMP convert the result to decimal, which it does in subquadratic time.
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gmp.h>
+#include "cf.h"
+
+// A 2x2 matrix [m[0] m[1]; m[2] m[3]]. After terms a_0, ..., a_k it is
+// [p_k p_{k-1}; q_k q_{k-1}].
+static void matrix_init(mpz_t m[4]) {
+  for (int i = 0; i < 4; i++) mpz_init(m[i]);
+}
+
+static void matrix_clear(mpz_t m[4]) {
+  for (int i = 0; i < 4; i++) mpz_clear(m[i]);
+}
+
+// m = m r.
+static void matrix_mul(mpz_t m[4], mpz_t r[4]) {
+  mpz_t t;
+  mpz_init(t);
+  for (int i = 0; i < 4; i += 2) {
+    mpz_mul(t, m[i], r[0]);
+    mpz_addmul(t, m[i + 1], r[2]);
+    mpz_mul(m[i + 1], m[i + 1], r[3]);
+    mpz_addmul(m[i + 1], m[i], r[1]);
+    mpz_swap(m[i], t);
+  }
+  mpz_clear(t);
+}
+
+// m = product of [a[i] 1; 1 0] for i in [lo, hi), using up to the given
+// number of threads.
+struct tree_s {
+  mpz_t *m, *a;
+  int lo, hi, threads;
+};
+
+static void *matrix_tree_thread(void *data) {
+  struct tree_s *t = data;
+  if (t->hi - t->lo == 1) {
+    mpz_set(t->m[0], t->a[t->lo]);
+    mpz_set_ui(t->m[1], 1);
+    mpz_set_ui(t->m[2], 1);
+    mpz_set_ui(t->m[3], 0);
+    return NULL;
+  }
+  int mid = t->lo + (t->hi - t->lo) / 2;
+  mpz_t r[4];
+  matrix_init(r);
+  struct tree_s left = { t->m, t->a, t->lo, mid, t->threads - t->threads / 2 };
+  struct tree_s right = { r, t->a, mid, t->hi, t->threads / 2 };
+  // Small products are not worth a thread.
+  if (t->threads > 1 && t->hi - t->lo >= 256) {
+    pthread_t thread;
+    pthread_create(&thread, NULL, matrix_tree_thread, &right);
+    matrix_tree_thread(&left);
+    pthread_join(thread, NULL);
+  } else {
+    left.threads = right.threads = 1;
+    matrix_tree_thread(&left);
+    matrix_tree_thread(&right);
+  }
+  matrix_mul(t->m, r);
+  matrix_clear(r);
+  return NULL;
+}
+
+static void matrix_tree(mpz_t m[4], mpz_t *a, int lo, int hi) {
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  struct tree_s t = { m, a, lo, hi, threads < 1 ? 1 : threads };
+  matrix_tree_thread(&t);
+}
+
+// Writes the decimal expansion of x, truncated to n digits after the point,
+// to buf, or to a newly allocated string if buf is NULL. Returns the string.
+// We pull terms until the last two convergents differ by less than 10^-n,
+// and then until their expansions agree, since x lies between them.
+char *cf_to_decimal_bulk(cf_t x, int n, char *buf) {
+  // Bits needed in q_k q_{k-1}.
+  size_t target = (size_t) (n * 3.3219280948873623) + 2;
+  mpz_t m[4], r[4];
+  matrix_init(m);
+  matrix_init(r);
+  mpz_set_ui(m[0], 1);
+  mpz_set_ui(m[3], 1);
+  int max = 64, len = 0;
+  mpz_t *a = malloc(sizeof(*a) * max);
+  int sign = 0;
+  // Set once x has ended, when it is exactly m[0]/m[2] unless it was cut
+  // short.
+  int done = 0;
+
+  // Pulls terms until their sizes add up to at least need bits, an upper
+  // bound on how much they can grow the convergents.
+  void pull(size_t need) {
+    size_t bits = 0;
+    len = 0;
+    do {
+      if (len == max) {
+        max *= 2;
+        a = realloc(a, sizeof(*a) * max);
+      }
+      mpz_init(a[len]);
+      if (!cf_get(a[len], x)) {
+        mpz_clear(a[len]);
+        done = 1;
+        break;
+      }
+      if (!sign) sign = cf_sign(x);
+      bits += mpz_sizeinbase(a[len], 2);
+      len++;
+    } while (bits < need);
+    if (len) {
+      matrix_tree(r, a, 0, len);
+      matrix_mul(m, r);
+    }
+    for (int i = 0; i < len; i++) mpz_clear(a[i]);
+  }
+  size_t have() {
+    if (!mpz_sgn(m[3])) return 0;
+    return mpz_sizeinbase(m[2], 2) + mpz_sizeinbase(m[3], 2) - 2;
+  }
+  for (size_t h; !done && (h = have()) < target;) pull((target - h + 1) / 2);
+
+  // Not in r, which pull() overwrites.
+  mpz_t d0, d1, ten;
+  mpz_init(d0); mpz_init(d1); mpz_init(ten);
+  mpz_ui_pow_ui(ten, 10, n);
+  int cut = 0;
+  for (;;) {
+    mpz_mul(d0, m[0], ten);
+    mpz_fdiv_q(d0, d0, m[2]);
+    if (done && !(cut = cf_cut(x))) break;
+    if (cut && !mpz_sgn(m[3])) break;
+    mpz_mul(d1, m[1], ten);
+    mpz_fdiv_q(d1, d1, m[3]);
+    if (!mpz_cmp(d0, d1) || cut) break;
+    pull(1);
+  }
+  if (cut && (!mpz_sgn(m[3]) || mpz_cmp(d0, d1))) {
+    free(a);
+    mpz_clear(d0); mpz_clear(d1); mpz_clear(ten);
+    matrix_clear(m);
+    matrix_clear(r);
+    return NULL;
+  }
+
+  char *s = malloc(mpz_sizeinbase(d0, 10) + 2);
+  mpz_get_str(s, 10, d0);
+  int slen = strlen(s);
+  // Pad with zeros so there is at least one digit before the point.
+  int pad = slen <= n ? n + 1 - slen : 0;
+  int total = (sign < 0) + slen + pad + (n > 0);
+  if (!buf) buf = malloc(total + 1);
+  char *c = buf;
+  if (sign < 0) *c++ = '-';
+  memset(c, '0', pad);
+  memcpy(c + pad, s, slen);
+  int ilen = slen + pad - n;
+  if (n > 0) {
+    memmove(c + ilen + 1, c + ilen, n);
+    c[ilen] = '.';
+  }
+  buf[total] = 0;
+
+  free(s);
+  free(a);
+  mpz_clear(d0); mpz_clear(d1); mpz_clear(ten);
+  matrix_clear(m);
+  matrix_clear(r);
+  return buf;
+}
+
+void cf_print_decimal(FILE *fp, cf_t x, int n) {
+  int i = 0;
+  if (n >= 10000) {
+    // Faster, but nothing appears until the end.
+    char *s = cf_to_decimal_bulk(x, n, NULL);
+    if (!s) return;
+    char *c = strchr(s, '.');
+    *c = 0;
+    fprintf(fp, "%s \n", s);
+    for (i = 1; i <= n; i++) {
+      putc(c[i], fp);
+      if (!(i % 5)) putc(' ', fp);
+      if (!(i % 50)) putc('\n', fp);
+    }
+    free(s);
+  } else {
+    mpz_t z;
+    mpz_init(z);
+    cf_t dec = cf_new_cf_to_decimal(x);
+    for (; i <= n && cf_get(z, dec); i++) {
+      // The terms are the digits of |x|.
+      if (!i && cf_sign(dec) < 0) putc('-', fp);
+      gmp_fprintf(fp, "%Zd", z);
+      if (!(i % 5)) putc(' ', fp);
+      if (!(i % 50)) putc('\n', fp);
+    }
+    cf_free(dec);
+    mpz_clear(z);
+  }
+  if (i && (i - 1) % 50) putc('\n', fp);
+}
+
+// Sets p/q to the convergent formed by the next n > 0 terms of x, or by
+// as many as are left, and returns how many that is. If none are left,
+// p and q are left alone.
+int cf_convergent_at(cf_t x, int n, mpz_t p, mpz_t q) {
+  mpz_t *a = malloc(sizeof(*a) * n);
+  for (int i = 0; i < n; i++) mpz_init(a[i]);
+  int k = cf_get_block(a, x, n);
+  if (k) {
+    mpz_t m[4];
+    matrix_init(m);
+    matrix_tree(m, a, 0, k);
+    mpz_swap(p, m[0]);
+    mpz_swap(q, m[2]);
+    if (cf_sign(x) < 0) mpz_neg(p, p);
+    matrix_clear(m);
+  }
+  for (int i = 0; i < n; i++) mpz_clear(a[i]);
+  free(a);
+  return k;
+}
+
+struct stride_s {
+  cf_t input;
+  mpz_t m[4];
+  int k;
+};
+typedef struct stride_s *stride_ptr;
+
+static void *convergent_stride(cf_t cf) {
+  stride_ptr sd = cf_data(cf);
+  int k = sd->k;
+  mpz_t *a = malloc(sizeof(*a) * k);
+  for (int i = 0; i < k; i++) mpz_init(a[i]);
+  mpz_t r[4];
+  matrix_init(r);
+  while(cf_wait(cf)) {
+    // If the input ends, the last convergent comes early.
+    int n = cf_get_block(a, sd->input, k);
+    if (!n) {
+      cf_put_end(cf);
+      break;
+    }
+    matrix_tree(r, a, 0, n);
+    matrix_mul(sd->m, r);
+    cf_put(cf, sd->m[0]);
+    cf_put(cf, sd->m[2]);
+  }
+  matrix_clear(r);
+  for (int i = 0; i < k; i++) mpz_clear(a[i]);
+  free(a);
+  matrix_clear(sd->m);
+  free(sd);
+  return NULL;
+}
+
+// Like cf_new_mobius_convergent(), but only outputs every kth convergent.
+cf_t cf_new_mobius_convergent_stride(cf_t x, mpz_t a, mpz_t b, mpz_t c,
+    mpz_t d, int k) {
+  stride_ptr sd = malloc(sizeof(*sd));
+  matrix_init(sd->m);
+  mpz_set(sd->m[0], a); mpz_set(sd->m[1], b);
+  mpz_set(sd->m[2], c); mpz_set(sd->m[3], d);
+  sd->input = x;
+  sd->k = k;
+  cf_t res = cf_new(convergent_stride, sd);
+  cf_add_input(res, x);
+  return res;
+}
+
+cf_t cf_new_cf_convergent_stride(cf_t x, int k) {
+  mpz_t one, zero;
+  mpz_init(one); mpz_init(zero);
+  mpz_set_ui(one, 1); mpz_set_ui(zero, 0);
+  cf_t res = cf_new_mobius_convergent_stride(x, one, zero, zero, one, k);
+  mpz_clear(one); mpz_clear(zero);
+  return res;
+}
+
+// The terms so far bound x to an interval of width 1/(q_k (q_k + q_{k-1})).
+// A term a multiplies both factors by at most a + 1, so we can read terms
+// into a block until their sizes say the width might be small enough, and
+// only then multiply them out and check.
+unsigned long cf_eval_to_bits(cf_t x, unsigned long bits, mpq_t out) {
+  cf_want_bits(x, bits);
+  mpz_t m[4], r[4], t;
+  matrix_init(m);
+  matrix_init(r);
+  mpz_init(t);
+  mpz_set_ui(m[0], 1);
+  mpz_set_ui(m[3], 1);
+  int max = 64;
+  mpz_t *a = malloc(sizeof(*a) * max);
+  unsigned long n = 0;
+  int ended = 0;
+  for (;;) {
+    // Bits the width must still shrink by, less at most one.
+    long need = 0;
+    if (n) {
+      mpz_add(t, m[2], m[3]);
+      mpz_mul(t, t, m[2]);
+      if (mpz_sizeinbase(t, 2) > bits) break;
+      need = bits - mpz_sizeinbase(t, 2);
+    }
+    long grow = 0;
+    int len = 0;
+    do {
+      if (len == max) {
+        max *= 2;
+        a = realloc(a, sizeof(*a) * max);
+      }
+      mpz_init(a[len]);
+      if (!cf_get(a[len], x)) {
+        // Then x = p_k/q_k exactly, unless x was cut short.
+        mpz_clear(a[len]);
+        ended = 1;
+        need = -1;
+        break;
+      }
+      grow += 2 * mpz_sizeinbase(a[len], 2);
+      len++;
+    } while (grow <= need);
+    if (len) {
+      matrix_tree(r, a, 0, len);
+      matrix_mul(m, r);
+    }
+    for (int i = 0; i < len; i++) mpz_clear(a[i]);
+    n += len;
+    if (need < 0) break;
+  }
+  if (ended && cf_cut(x)) n = 0;
+  mpz_set(mpq_numref(out), m[0]);
+  mpz_set(mpq_denref(out), m[2]);
+  if (cf_sign(x) < 0) mpq_neg(out, out);
+  free(a);
+  mpz_clear(t);
+  matrix_clear(m);
+  matrix_clear(r);
+  return n;
+}
+
+// After terms a_0, ..., a_k, x = (p_k t + p_{k-1})/(q_k t + q_{k-1}) for
+// some t >= 1, so x lies between p_k/q_k and (p_k + p_{k-1})/(q_k + q_{k-1}).
+unsigned long cf_approx_by_deadline(cf_t x, const struct timespec *deadline,
+    mpq_t lo, mpq_t hi) {
+  mpz_t m[4], a;
+  matrix_init(m);
+  mpz_init(a);
+  mpz_set_ui(m[0], 1);
+  mpz_set_ui(m[3], 1);
+  unsigned long n = 0;
+  while (cf_get_timed(a, x, deadline)) {
+    mpz_addmul(m[1], a, m[0]);
+    mpz_swap(m[0], m[1]);
+    mpz_addmul(m[3], a, m[2]);
+    mpz_swap(m[2], m[3]);
+    n++;
+  }
+  if (n) {
+    // After an odd number of terms, p_k/q_k is the lower bound.
+    mpq_ptr r0 = n & 1 ? lo : hi, r1 = n & 1 ? hi : lo;
+    mpz_set(mpq_numref(r0), m[0]);
+    mpz_set(mpq_denref(r0), m[2]);
+    mpz_add(mpq_numref(r1), m[0], m[1]);
+    mpz_add(mpq_denref(r1), m[2], m[3]);
+    mpq_canonicalize(lo);
+    mpq_canonicalize(hi);
+    if (cf_sign(x) < 0) {
+      mpq_neg(lo, lo);
+      mpq_neg(hi, hi);
+      mpq_swap(lo, hi);
+    }
+  }
+  mpz_clear(a);
+  matrix_clear(m);
+  return n;
+}
+
+// The closest fraction to |x| with denominator at most N is the last
+// convergent p_k/q_k with q_k <= N, or the semiconvergent
+// (j p_k + p_{k-1})/(j q_k + q_{k-1}) with the largest j that keeps its
+// denominator within N, where j < a_{k+1}. Writing
+// x = (p_k t + p_{k-1})/(q_k t + q_{k-1}), the semiconvergent is closer
+// exactly when t < 2j + q_{k-1}/q_k. So it is when 2j > a_{k+1}, and when
+// 2j = a_{k+1}, it is if the rest of x after a_{k+1} is more than
+// q_k/q_{k-1} = [a_k; a_{k-1}, ..., a_1].
+//
+// Convergents are kept in words until they outgrow them.
+int cf_best_approx(cf_t x, mpz_t maxden, mpz_t p, mpz_t q) {
+  mpz_t m[4];
+  matrix_init(m);
+  mpz_set_ui(m[0], 1);
+  mpz_set_ui(m[3], 1);
+  int max = 16, n = 0;
+  mpz_t *a = malloc(sizeof(*a) * max);
+  unsigned long w[4] = { 1, 0, 0, 1 }, N = 0;
+  int word = mpz_fits_ulong_p(maxden);
+  if (word) N = mpz_get_ui(maxden);
+  int ended = 0;
+  for (;;) {
+    if (n == max) a = realloc(a, sizeof(*a) * (max *= 2));
+    mpz_init(a[n]);
+    if (!cf_get(a[n], x)) {
+      mpz_clear(a[n]);
+      ended = 1;
+      break;
+    }
+    mpz_ptr t = a[n++];
+    // The first denominator, 1, is always within bounds.
+    if (word && mpz_fits_ulong_p(t)) {
+      unsigned long u = mpz_get_ui(t);
+      unsigned __int128 qn = (unsigned __int128) u * w[2] + w[3];
+      if (n > 1 && qn > N) break;
+      unsigned __int128 pn = (unsigned __int128) u * w[0] + w[1];
+      if (!(pn >> 64)) {
+        w[1] = w[0];
+        w[0] = pn;
+        w[3] = w[2];
+        w[2] = qn;
+        continue;
+      }
+    }
+    if (word) {
+      word = 0;
+      for (int i = 0; i < 4; i++) mpz_set_ui(m[i], w[i]);
+    }
+    if (n > 1) {
+      mpz_mul(p, t, m[2]);
+      mpz_add(p, p, m[3]);
+      if (mpz_cmp(p, maxden) > 0) break;
+    }
+    mpz_addmul(m[1], t, m[0]);
+    mpz_swap(m[0], m[1]);
+    mpz_addmul(m[3], t, m[2]);
+    mpz_swap(m[2], m[3]);
+  }
+  if (word) for (int i = 0; i < 4; i++) mpz_set_ui(m[i], w[i]);
+  if (!n) mpz_set_ui(m[2], 1);  // No terms: take x as 0.
+  int semi = 0, res = 1;
+  if (ended && cf_cut(x)) {
+    // The next term is unknown, so p_k/q_k is only sure to be the answer if
+    // no semiconvergent fits.
+    mpz_add(q, m[2], m[3]);
+    res = n && mpz_cmp(q, maxden) > 0;
+  } else if (!ended) {
+    // a[n - 1] = a_{k+1} would overshoot, so j = (N - q_{k-1}) / q_k.
+    mpz_ptr t = a[n - 1];
+    mpz_sub(q, maxden, m[3]);
+    mpz_fdiv_q(q, q, m[2]);
+    mpz_mul_2exp(p, q, 1);
+    int c = mpz_sgn(q) ? mpz_cmp(p, t) : -1;
+    if (c > 0) {
+      semi = 1;
+    } else if (!c) {
+      // Compare the rest of x with [a_k; ..., a_1], reading terms until
+      // they differ. A finished expansion has an infinite next term.
+      // Values rise with even terms and fall with odd ones.
+      int k = n - 2, len = k;
+      if (k >= 2 && !mpz_cmp_ui(a[1], 1)) {
+        // Written without a last term of 1: [a_k; ..., a_2 + 1].
+        len--;
+        mpz_add_ui(a[2], a[2], 1);
+      }
+      if (n == max) a = realloc(a, sizeof(*a) * (max + 1));
+      mpz_init(a[n]);
+      for (int i = 0;; i++) {
+        int xend = !cf_get(a[n], x), rend = i >= len;
+        if (xend && cf_cut(x)) {
+          res = 0;
+          break;
+        }
+        if (xend || rend) {
+          semi = !rend ? !(i & 1) : !xend ? i & 1 : 0;
+          break;
+        }
+        int d = mpz_cmp(a[n], a[k - i]);
+        if (d) {
+          semi = (d > 0) ^ (i & 1);
+          break;
+        }
+      }
+      mpz_clear(a[n]);
+    }
+  }
+  if (semi) {
+    mpz_mul(p, q, m[0]);
+    mpz_add(p, p, m[1]);
+    mpz_mul(q, q, m[2]);
+    mpz_add(q, q, m[3]);
+  } else {
+    mpz_set(p, m[0]);
+    mpz_set(q, m[2]);
+  }
+  if (n && cf_sign(x) < 0) mpz_neg(p, p);
+  for (int i = 0; i < n; i++) mpz_clear(a[i]);
+  free(a);
+  matrix_clear(m);
+  return res;
+}
@@ -0,0 +1,186 @@
+// Test conversions from many terms at once.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "cf.h"
+#include "test.h"
+
+// Expect the bulk decimal expansion of a new x to be str.
+static void expect_bulk(cf_t x, int n, char *str) {
+  char *s = cf_to_decimal_bulk(x, n, NULL);
+  EXPECT(!strcmp(s, str));
+  if (strcmp(s, str)) fprintf(stderr, "  expected: %s\n    actual: %s\n",
+      str, s);
+  free(s);
+  cf_free(x);
+}
+
+int main() {
+  expect_bulk(cf_new_e(), 40, "2.7182818284590452353602874713526624977572");
+  expect_bulk(cf_new_sqrt2(), 0, "1");
+  expect_bulk(cf_new_sin_int(69, 1), 30,
+      "-0.114784813783187220545071833558");
+  expect_bulk(cf_new_sin_int(1, 100), 12, "0.009999833334");
+  // Needs more terms after the convergents are close enough.
+  expect_bulk(cf_new_sqrt_int(411788, 1), 10, "641.7070982932");
+
+  // Agrees with the digit-by-digit conversion.
+  int n = 3000;
+  char s[n + 3];
+  cf_t pi = cf_new_pi_chudnovsky();
+  cf_t conv = cf_new_cf_to_decimal(pi);
+  mpz_t z;
+  mpz_init(z);
+  cf_get(z, conv);
+  gmp_sprintf(s, "%Zd.", z);
+  for (int i = 2; i < n + 2; i++) {
+    cf_get(z, conv);
+    s[i] = '0' + mpz_get_ui(z);
+  }
+  s[n + 2] = 0;
+  cf_free(conv);
+  cf_free(pi);
+  expect_bulk(cf_new_pi_chudnovsky(), n, s);
+
+  // Random access and strided convergents agree with the usual stream.
+  mpz_t p, q, p1, q1;
+  mpz_init(p); mpz_init(q); mpz_init(p1); mpz_init(q1);
+  cf_t e = cf_new_e();
+  cf_t conv1 = cf_new_cf_convergent(e);
+  cf_t e2 = cf_new_e();
+  cf_t stride = cf_new_cf_convergent_stride(e2, 7);
+  for (int i = 1; i <= 700; i++) {
+    cf_get(p1, conv1);
+    cf_get(q1, conv1);
+    if (i % 7) continue;
+    cf_get(p, stride);
+    cf_get(q, stride);
+    EXPECT(!mpz_cmp(p, p1) && !mpz_cmp(q, q1));
+  }
+  cf_free(stride);
+  cf_free(e2);
+  e2 = cf_new_e();
+  cf_convergent_at(e2, 700, p, q);
+  EXPECT(!mpz_cmp(p, p1) && !mpz_cmp(q, q1));
+  cf_free(e2);
+  cf_free(conv1);
+  cf_free(e);
+
+  cf_t y = cf_new_sin_int(69, 1);
+  cf_convergent_at(y, 3, p, q);
+  EXPECT(!mpz_cmp_si(p, -1) && !mpz_cmp_ui(q, 9));
+  cf_free(y);
+
+  // Evaluation to a given precision stops at the first convergent whose
+  // bounds are tight enough.
+  mpq_t r;
+  mpq_init(r);
+  for (unsigned long bits = 1; bits < 3000; bits = bits * 3 + 1) {
+    e = cf_new_e();
+    unsigned long k = cf_eval_to_bits(e, bits, r);
+    cf_free(e);
+    e = cf_new_e();
+    conv = cf_new_cf_convergent(e);
+    mpz_set_ui(q1, 0);
+    unsigned long i = 0;
+    do {
+      mpz_swap(q, q1);
+      cf_get(p1, conv);
+      cf_get(q1, conv);
+      mpz_add(z, q, q1);
+      mpz_mul(z, z, q1);
+      i++;
+    } while (mpz_sizeinbase(z, 2) <= bits);
+    EXPECT(k == i);
+    EXPECT(!mpz_cmp(mpq_numref(r), p1) && !mpz_cmp(mpq_denref(r), q1));
+    cf_free(conv);
+    cf_free(e);
+  }
+  // Within 2^-64 of sin(69) = -0.114784813783187220545071833558...
+  mpq_t r1;
+  mpq_init(r1);
+  y = cf_new_sin_int(69, 1);
+  cf_eval_to_bits(y, 64, r);
+  cf_free(y);
+  mpq_set_str(r1, "-114784813783187220545071833558", 10);
+  mpz_ui_pow_ui(mpq_denref(r1), 10, 30);
+  mpq_canonicalize(r1);
+  mpq_sub(r, r, r1);
+  mpq_abs(r, r);
+  mpz_set_ui(mpq_numref(r1), 1);
+  mpz_ui_pow_ui(mpq_denref(r1), 2, 64);
+  EXPECT(mpq_cmp(r, r1) < 0);
+  mpq_clear(r1);
+  mpq_clear(r);
+
+  // Best approximations, in words and past them.
+  struct {
+    char *x, *maxden, *p, *q;
+  } best[] = {
+    { "pi", "1", "3", "1" },
+    { "pi", "10", "22", "7" },
+    { "pi", "100", "311", "99" },
+    { "pi", "1000", "355", "113" },
+    { "pi", "1000000", "3126535", "995207" },
+    { "e", "2", "5", "2" },
+    { "e", "1000", "1457", "536" },
+    { "e", "1000000000000", "1098127402131", "403978495031" },
+    { "e", "1000000000000000000000000000000",
+        "551157654494325100219720823521", "202759569932735203392750534601" },
+    { "-sqrt(2)", "1000", "-1393", "985" },
+  };
+  for (int i = 0; i < sizeof(best) / sizeof(*best); i++) {
+    cf_t x = cf_parse(best[i].x);
+    mpz_set_str(z, best[i].maxden, 10);
+    cf_best_approx(x, z, p, q);
+    mpz_set_str(p1, best[i].p, 10);
+    mpz_set_str(q1, best[i].q, 10);
+    EXPECT(!mpz_cmp(p, p1) && !mpz_cmp(q, q1));
+    cf_free(x);
+  }
+
+  // Against a search of every denominator, for rationals, whose ties
+  // between a convergent and a semiconvergent need more terms.
+  mpq_t d, dbest;
+  mpq_init(r);
+  mpq_init(d);
+  mpq_init(dbest);
+  for (long num = -40; num <= 40; num++) {
+    for (long den = 1; den <= 40; den++) {
+      mpq_set_si(r, num, den);
+      mpq_canonicalize(r);
+      for (long n = 1; n <= 12; n++) {
+        cf_t x = cf_new_from_mpq(r);
+        mpz_set_ui(z, n);
+        cf_best_approx(x, z, p, q);
+        cf_free(x);
+        // The closest, with the smallest denominator on ties.
+        long bq = 0;
+        for (long k = 1; k <= n; k++) {
+          for (long j = -1; j <= 1; j++) {
+            mpq_set_si(d, num * k / den + j, k);
+            mpq_sub(d, d, r);
+            mpq_abs(d, d);
+            if (!bq || mpq_cmp(d, dbest) < 0) {
+              mpq_set(dbest, d);
+              bq = k;
+            }
+          }
+        }
+        mpq_set_si(d, mpz_get_si(p), mpz_get_ui(q));
+        mpq_sub(d, d, r);
+        mpq_abs(d, d);
+        EXPECT(mpq_equal(d, dbest) && !mpz_cmp_ui(q, bq));
+      }
+    }
+  }
+  mpq_clear(d);
+  mpq_clear(dbest);
+  mpq_clear(r);
+
+  mpz_clear(p); mpz_clear(q); mpz_clear(p1); mpz_clear(q1);
+  mpz_clear(z);
+  return 0;
+}
@@ -0,0 +1,350 @@
+// Conversions between continued fractions and other representations.
+//
+// To floating point: after terms a_0, ..., a_k of |x|, it lies between
+// p_k/q_k and (p_k + p_{k-1})/(q_k + q_{k-1}). Rounding is monotonic, so
+// once both ends round to the same float, x does too. Further terms
+// eventually also put the float outside the bracket, which tells us which
+// way x was rounded, unless x ends, when it is p_k/q_k exactly. If x was
+// cut short, the bracket is all we have.
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#ifdef HAVE_MPFR
+#include <mpfr.h>
+#endif
+#include "cf.h"
+
+// Ways to round |x|: toward zero, away from zero, or to nearest with ties
+// to even.
+enum { ROUND_DOWN, ROUND_UP, ROUND_NEAREST };
+
+// Sets r 2^e to n/d >= 0 rounded to prec bits, or to a multiple of 2^emin
+// if smaller. Needs two scratch integers t.
+static void round_q(mpz_t r, long *e, mpz_t n, mpz_t d,
+    unsigned long prec, long emin, int mode, mpz_t t[2]) {
+  // Then n/d >= 2^(k + prec - 1), and r < 2^(prec + 1) at first.
+  long k = (long) mpz_sizeinbase(n, 2) - (long) mpz_sizeinbase(d, 2)
+      - (long) prec;
+  if (k < emin) k = emin;
+  for (;;) {
+    if (k >= 0) {
+      mpz_set(t[0], n);
+      mpz_mul_2exp(t[1], d, k);
+    } else {
+      mpz_mul_2exp(t[0], n, -k);
+      mpz_set(t[1], d);
+    }
+    mpz_fdiv_qr(r, t[0], t[0], t[1]);
+    if (mpz_sizeinbase(r, 2) <= prec) break;
+    k++;
+  }
+  int up = 0;
+  if (mpz_sgn(t[0])) {
+    if (mode == ROUND_UP) {
+      up = 1;
+    } else if (mode == ROUND_NEAREST) {
+      mpz_mul_2exp(t[0], t[0], 1);
+      int c = mpz_cmp(t[0], t[1]);
+      up = c > 0 || (!c && mpz_odd_p(r));
+    }
+  }
+  if (up) {
+    mpz_add_ui(r, r, 1);
+    if (mpz_sizeinbase(r, 2) > prec) {
+      mpz_tdiv_q_2exp(r, r, 1);
+      k++;
+    }
+  }
+  *e = k;
+}
+
+// Returns the sign of r 2^e - n/d.
+static int cmp_q(mpz_t r, long e, mpz_t n, mpz_t d, mpz_t t[2]) {
+  mpz_mul(t[0], r, d);
+  if (e >= 0) {
+    mpz_mul_2exp(t[0], t[0], e);
+    return mpz_cmp(t[0], n);
+  }
+  mpz_mul_2exp(t[1], n, -e);
+  return mpz_cmp(t[0], t[1]);
+}
+
+// m = [p_k p_{k-1}; q_k q_{k-1}] after the term a.
+static void bracket_push(mpz_t m[4], mpz_t a) {
+  mpz_addmul(m[1], a, m[0]);
+  mpz_swap(m[0], m[1]);
+  mpz_addmul(m[3], a, m[2]);
+  mpz_swap(m[2], m[3]);
+}
+
+// Given the matrix m of the terms of |x| read so far, reads more until the
+// rounding of |x| to prec bits, or to a multiple of 2^emin if smaller, is
+// settled, and sets r 2^e to it. Returns the sign of r 2^e - |x|, or 2 if
+// x was cut short first.
+static int round_bracket(mpz_t r, long *e, cf_t x, mpz_t m[4],
+    unsigned long prec, long emin, int mode) {
+  mpz_t a, n, d, r1, t[2];
+  mpz_init(a); mpz_init(n); mpz_init(d); mpz_init(r1);
+  mpz_init(t[0]); mpz_init(t[1]);
+  int res, cut = 0;
+  for (;;) {
+    // The bracket is about 1/q_k^2 wide, and an ulp about |x| 2^-prec,
+    // so there is no point looking before p_k q_k > 2^prec.
+    if (cut || mpz_sizeinbase(m[0], 2) + mpz_sizeinbase(m[2], 2) > prec) {
+      long e1;
+      mpz_add(n, m[0], m[1]);
+      mpz_add(d, m[2], m[3]);
+      round_q(r, e, m[0], m[2], prec, emin, mode, t);
+      round_q(r1, &e1, n, d, prec, emin, mode, t);
+      if (*e == e1 && !mpz_cmp(r, r1)) {
+        int c0 = cmp_q(r, *e, m[0], m[2], t);
+        int c1 = cmp_q(r, *e, n, d, t);
+        if (c0 && c0 == c1) {
+          res = c0;
+          break;
+        }
+      }
+      if (cut) {
+        res = 2;
+        break;
+      }
+    }
+    if (!cf_get(a, x)) {
+      if ((cut = cf_cut(x))) continue;
+      round_q(r, e, m[0], m[2], prec, emin, mode, t);
+      res = cmp_q(r, *e, m[0], m[2], t);
+      break;
+    }
+    bracket_push(m, a);
+  }
+  mpz_clear(a); mpz_clear(n); mpz_clear(d); mpz_clear(r1);
+  mpz_clear(t[0]); mpz_clear(t[1]);
+  return res;
+}
+
+// Reads the first term of x, and sets m to the bracket it gives.
+static int bracket_start(mpz_t m[4], cf_t x) {
+  for (int i = 0; i < 4; i++) mpz_init(m[i]);
+  cf_get(m[0], x);
+  mpz_set_ui(m[1], 1);
+  mpz_set_ui(m[2], 1);
+  return cf_sign(x);
+}
+
+static void bracket_clear(mpz_t m[4]) {
+  for (int i = 0; i < 4; i++) mpz_clear(m[i]);
+}
+
+// Like exercise.c, we run the recurrence in machine words while we can.
+// While the numerators and denominators are below 2^53, they convert to
+// double exactly, and the FPU rounds their quotients correctly.
+double cf_get_d(cf_t x) {
+  const long lim = 1L << 53;
+  mpz_t a, m[4];
+  mpz_init(a);
+  cf_get(a, x);
+  int sign = cf_sign(x);
+  long p = 1, pold = 0, q = 0, qold = 1, w, p1, q1;
+  double res;
+  for (;;) {
+    if (!cf_word_get(&w, a) || !cf_word_muladd(&p1, w, p, pold) ||
+        !cf_word_muladd(&q1, w, q, qold) || p1 + p >= lim || q1 + q >= lim) {
+      break;
+    }
+    pold = p;
+    p = p1;
+    qold = q;
+    q = q1;
+    double lo = (double) p / q, hi = (double) (p + pold) / (q + qold);
+    if (lo == hi || !cf_get(a, x)) {
+      if (lo != hi && cf_cut(x)) lo = NAN;
+      mpz_clear(a);
+      return sign < 0 ? -lo : lo;
+    }
+  }
+
+  // Carry on with the pending term in multiprecision.
+  for (int i = 0; i < 4; i++) mpz_init(m[i]);
+  mpz_set_si(m[0], p);
+  mpz_set_si(m[1], pold);
+  mpz_set_si(m[2], q);
+  mpz_set_si(m[3], qold);
+  bracket_push(m, a);
+  long e;
+  if (round_bracket(a, &e, x, m, 53, -1074, ROUND_NEAREST) == 2) res = NAN;
+  else res = ldexp(mpz_get_d(a), e);
+  bracket_clear(m);
+  mpz_clear(a);
+  return sign < 0 ? -res : res;
+}
+
+// Like the mpf functions, truncates to the precision of f.
+int cf_get_mpf(mpf_t f, cf_t x) {
+  mpz_t m[4], r;
+  mpz_init(r);
+  int sign = bracket_start(m, x);
+  long e;
+  if (round_bracket(r, &e, x, m, mpf_get_prec(f), LONG_MIN / 4,
+      ROUND_DOWN) == 2) {
+    bracket_clear(m);
+    mpz_clear(r);
+    return 0;
+  }
+  mpf_set_z(f, r);
+  if (e >= 0) {
+    mpf_mul_2exp(f, f, e);
+  } else {
+    mpf_div_2exp(f, f, -e);
+  }
+  if (sign < 0) mpf_neg(f, f);
+  bracket_clear(m);
+  mpz_clear(r);
+  return 1;
+}
+
+#ifdef HAVE_MPFR
+int cf_get_mpfr(mpfr_t f, cf_t x, mpfr_rnd_t rnd) {
+  mpz_t m[4], r;
+  mpz_init(r);
+  int sign = bracket_start(m, x);
+  int mode;
+  switch (rnd) {
+    case MPFR_RNDZ:
+      mode = ROUND_DOWN;
+      break;
+    case MPFR_RNDA:
+      mode = ROUND_UP;
+      break;
+    case MPFR_RNDU:
+      mode = sign < 0 ? ROUND_DOWN : ROUND_UP;
+      break;
+    case MPFR_RNDD:
+      mode = sign < 0 ? ROUND_UP : ROUND_DOWN;
+      break;
+    default:
+      mode = ROUND_NEAREST;
+      break;
+  }
+  long e;
+  int res = round_bracket(r, &e, x, m, mpfr_get_prec(f), LONG_MIN / 4,
+      mode);
+  if (res == 2) {
+    mpfr_set_nan(f);
+    bracket_clear(m);
+    mpz_clear(r);
+    return 0;
+  }
+  if (sign < 0) {
+    mpz_neg(r, r);
+    res = -res;
+  }
+  // Exact unless out of the exponent range.
+  int t = mpfr_set_z_2exp(f, r, e, rnd);
+  bracket_clear(m);
+  mpz_clear(r);
+  return t ? t : res;
+}
+#endif
+
+// A rational number, as a finite continued fraction.
+static void *from_mpq(cf_t cf) {
+  mpq_ptr q = cf_data(cf);
+  if (mpq_sgn(q) < 0) {
+    cf_set_sign(cf, -1);
+    mpq_neg(q, q);
+  }
+  if (cf_wait(cf)) cf_put_rational(cf, mpq_numref(q), mpq_denref(q));
+  mpq_clear(q);
+  free(q);
+  return NULL;
+}
+
+cf_t cf_new_from_mpq(mpq_t q) {
+  mpq_ptr data = malloc(sizeof(*data));
+  mpq_init(data);
+  mpq_set(data, q);
+  return cf_new(from_mpq, data);
+}
+
+// Every finite double is a dyadic rational.
+cf_t cf_new_from_double(double d) {
+  mpq_t q;
+  mpq_init(q);
+  mpq_set_d(q, d);
+  cf_t res = cf_new_from_mpq(q);
+  mpq_clear(q);
+  return res;
+}
+
+// Decimal input: once the integer part n is known, x = n + y for the value
+// y in [0, 1] of the digits to come, and each digit d turns y into
+// (d + y)/10. We keep x = (a y + b)/(c y + d) as digits arrive, and as in
+// cf_new_mobius_to_cf(), output a term whenever b/d and (a + b)/(c + d)
+// share an integer part. At the end, y = 0.
+static void *from_decimal_stream(cf_t cf) {
+  FILE *fp = cf_data(cf);
+  mpz_t m[4], t0, t1;
+  for (int i = 0; i < 4; i++) mpz_init(m[i]);
+  mpz_init(t0); mpz_init(t1);
+  int c;
+  while ((c = getc(fp)) == ' ' || c == '\t' || c == '\n' || c == '\r');
+  if (c == '-' || c == '+') {
+    if (c == '-') cf_set_sign(cf, -1);
+    c = getc(fp);
+  }
+  // The integer part fixes the scale of the rest, so we need all of it.
+  for (; c >= '0' && c <= '9'; c = getc(fp)) {
+    mpz_mul_ui(m[1], m[1], 10);
+    mpz_add_ui(m[1], m[1], c - '0');
+  }
+  int more = c == '.';
+  if (!more && c != EOF) ungetc(c, fp);
+  mpz_set_ui(m[0], 1);
+  mpz_set_ui(m[3], 1);
+
+  // Outputs a term and returns 1 if the bounds agree on it.
+  int recur() {
+    mpz_add(t1, m[2], m[3]);
+    if (!mpz_sgn(m[3]) || !mpz_sgn(t1)) return 0;
+    mpz_add(t0, m[0], m[1]);
+    mpz_fdiv_q(t1, t0, t1);
+    mpz_fdiv_q(t0, m[1], m[3]);
+    if (mpz_cmp(t0, t1)) return 0;
+    cf_put(cf, t0);
+    // x = t + 1/x'.
+    mpz_submul(m[0], t0, m[2]);
+    mpz_submul(m[1], t0, m[3]);
+    mpz_swap(m[0], m[2]);
+    mpz_swap(m[1], m[3]);
+    return 1;
+  }
+  // Reads a digit into the bounds. Returns 0 at the end of the digits.
+  int digit() {
+    int c = getc(fp);
+    if (c < '0' || c > '9') {
+      if (c != EOF) ungetc(c, fp);
+      return 0;
+    }
+    mpz_mul_ui(m[1], m[1], 10);
+    mpz_addmul_ui(m[1], m[0], c - '0');
+    mpz_mul_ui(m[3], m[3], 10);
+    mpz_addmul_ui(m[3], m[2], c - '0');
+    return 1;
+  }
+  while (cf_wait(cf)) {
+    while (more && !recur()) more = digit();
+    if (!more) {
+      cf_put_rational(cf, m[1], m[3]);
+      break;
+    }
+  }
+  for (int i = 0; i < 4; i++) mpz_clear(m[i]);
+  mpz_clear(t0); mpz_clear(t1);
+  return NULL;
+}
+
+cf_t cf_new_from_decimal_stream(FILE *fp) {
+  return cf_new(from_decimal_stream, fp);
+}
@@ -0,0 +1,146 @@
+// Test correctly rounded conversions to floating point.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include "cf.h"
+#include "test.h"
+
+static void *sqrt2(cf_t cf) {
+  cf_put_int(cf, 1);
+  while(cf_wait(cf)) {
+    cf_put_int(cf, 2);
+  }
+  return NULL;
+}
+
+static void *neg_sqrt2(cf_t cf) {
+  cf_set_sign(cf, -1);
+  return sqrt2(cf);
+}
+
+// Expect x to be sign [a[0]; a[1], ..., a[n - 1]] exactly, and frees it.
+static void expect_terms(cf_t x, int sign, int *a, int n) {
+  mpz_t z;
+  mpz_init(z);
+  for (int i = 0; i < n; i++) {
+    EXPECT(cf_get(z, x) && !mpz_cmp_si(z, a[i]));
+  }
+  EXPECT(!cf_get(z, x));
+  EXPECT(!cf_get(z, x));
+  EXPECT(cf_sign(x) == sign);
+  mpz_clear(z);
+  cf_free(x);
+}
+
+static cf_t new_mpq(long p, long q) {
+  mpq_t r;
+  mpq_init(r);
+  mpq_set_si(r, p, q);
+  mpq_canonicalize(r);
+  cf_t x = cf_new_from_mpq(r);
+  mpq_clear(r);
+  return x;
+}
+
+// A decimal stream over a temporary file holding s.
+static cf_t new_dec(char *s) {
+  FILE *fp = tmpfile();
+  fputs(s, fp);
+  rewind(fp);
+  return cf_new_from_decimal_stream(fp);
+}
+
+static void expect_d(cf_t x, double res) {
+  EXPECT(cf_get_d(x) == res);
+  cf_free(x);
+}
+
+int main() {
+  expect_d(cf_new_sqrt2(), 1.4142135623730951);
+  expect_d(cf_new_const(neg_sqrt2), -1.4142135623730951);
+  expect_d(cf_new_e(), 2.718281828459045);
+  expect_d(cf_new_pi(), 3.141592653589793);
+  expect_d(cf_new_sin_int(69, 1), -0.11478481378318722);
+  // Past 2^53, and tiny enough to need a subnormal.
+  mpz_t z[4], big;
+  for (int i = 0; i < 4; i++) mpz_init(z[i]);
+  mpz_init(big);
+  mpz_ui_pow_ui(z[0], 10, 17);
+  mpz_set_ui(z[3], 1);
+  cf_t x = cf_new_const(sqrt2);
+  expect_d(cf_new_mobius_to_cf(x, z), 1.414213562373095e+17);
+  cf_free(x);
+  mpz_set_ui(z[0], 0);
+  mpz_set_ui(z[1], 1);
+  mpz_ui_pow_ui(z[2], 10, 320);
+  mpz_set_ui(z[3], 0);
+  x = cf_new_const(sqrt2);
+  expect_d(cf_new_mobius_to_cf(x, z), 7.07e-321);
+  cf_free(x);
+
+  // Truncated to the precision of an mpf_t: floor(2^(n - 1) sqrt 2) 2^(1 - n).
+  mpf_t f, g;
+  mpf_init2(f, 200);
+  mpf_init2(g, 400);
+  unsigned long n = mpf_get_prec(f);
+  mpz_set_ui(big, 2);
+  mpz_mul_2exp(big, big, 2 * (n - 1));
+  mpz_sqrt(big, big);
+  mpf_set_z(g, big);
+  mpf_div_2exp(g, g, n - 1);
+  x = cf_new_sqrt2();
+  cf_get_mpf(f, x);
+  EXPECT(!mpf_cmp(f, g));
+  cf_free(x);
+  x = cf_new_const(neg_sqrt2);
+  cf_get_mpf(f, x);
+  mpf_neg(g, g);
+  EXPECT(!mpf_cmp(f, g));
+  cf_free(x);
+  mpf_clear(f);
+  mpf_clear(g);
+
+  // Finite continued fractions.
+  expect_terms(new_mpq(-7, 3), -1, (int[]){2, 3}, 2);
+  expect_terms(new_mpq(0, 1), 1, (int[]){0}, 1);
+  expect_terms(cf_new_from_double(0.375), 1, (int[]){0, 2, 1, 2}, 4);
+  expect_terms(new_dec(" 3.14159"), 1, (int[]){3, 7, 15, 1, 25, 1, 7, 4}, 8);
+  expect_terms(new_dec("-0.5x"), -1, (int[]){0, 2}, 2);
+  expect_terms(new_dec("42"), 1, (int[]){42}, 1);
+  expect_d(new_mpq(1, 3), 1.0 / 3);
+  expect_d(cf_new_from_double(0.1), 0.1);
+  expect_d(new_dec("2.718281828459045235360287471352662497757"),
+      2.718281828459045);
+
+  // Through Mobius transformations, bihomographic functions and tees.
+  cf_t r = new_mpq(1, 3);
+  mpz_set_ui(z[0], 2);
+  mpz_set_ui(z[1], 1);
+  mpz_set_ui(z[2], 0);
+  mpz_set_ui(z[3], 1);
+  expect_terms(cf_new_mobius_to_cf(r, z), 1, (int[]){1, 1, 2}, 3);
+  cf_free(r);
+  r = new_dec("0.125");
+  CF_EXPECT_DEC(r, "0.12500");
+  cf_free(r);
+  cf_t s2 = new_dec("0.5"), h = new_mpq(1, 2);
+  expect_terms(cf_new_add(s2, h), 1, (int[]){1}, 1);
+  cf_free(s2);
+  cf_free(h);
+  s2 = cf_new_sqrt2();
+  h = new_mpq(1, 1);
+  x = cf_new_sub(s2, h);
+  CF_EXPECT_DEC(x, "0.41421356237309504880");
+  cf_free(x);
+  cf_free(s2);
+  cf_free(h);
+  cf_t t[2];
+  cf_tee(t, new_mpq(13, 5));
+  expect_terms(t[0], 1, (int[]){2, 1, 1, 2}, 4);
+  expect_terms(t[1], 1, (int[]){2, 1, 1, 2}, 4);
+
+  for (int i = 0; i < 4; i++) mpz_clear(z[i]);
+  mpz_clear(big);
+  return 0;
+}
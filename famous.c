@@ -1,67 +1,51 @@
 // TODO: Use cf_new_const_nonregular instead of regularized_pi by allowing
 // arbitrary starting Mobius function.
+//
+// The terms of these expansions have closed forms, so they are indexed
+// sources: see cf_new_indexed().
 #include <stdio.h>
 #include <stdlib.h>
 #include <gmp.h>
 #include "cf.h"
 
 // sqrt(n^2 + 1) = [n; 2n, 2n, ...]
-static void *sqrt_easy(cf_t cf) {
-  unsigned int n = (unsigned int) cf_data(cf);
-  cf_put_int(cf, n);
-  n += n;
-  while(cf_wait(cf)) {
-    cf_put_int(cf, n);
-  }
-  return NULL;
+static void sqrt_easy(mpz_t z, unsigned long i, void *data) {
+  unsigned long n = (unsigned long) data;
+  mpz_set_ui(z, i ? 2 * n : n);
 }
 
 cf_t cf_new_sqrt2() {
-  return cf_new(sqrt_easy, (void *) 1);
+  return cf_new_indexed(sqrt_easy, NULL, (void *) 1);
 }
 
 cf_t cf_new_sqrt5() {
-  return cf_new(sqrt_easy, (void *) 2);
+  return cf_new_indexed(sqrt_easy, NULL, (void *) 2);
 }
 
 // e = [2; 1, 2, 1, 1, 4, 1, ...]
-static void *e_expansion(cf_t cf) {
-  int even = 2;
-  cf_put_int(cf, even);
-
-  while(cf_wait(cf)) {
-    cf_put_int(cf, 1);
-    cf_put_int(cf, even);
-    even += 2;
-    cf_put_int(cf, 1);
+static void e_expansion(mpz_t z, unsigned long i, void *data) {
+  if (!i) {
+    mpz_set_ui(z, 2);
+  } else if (i % 3 == 2) {
+    mpz_set_ui(z, 2 * (i / 3 + 1));
+  } else {
+    mpz_set_ui(z, 1);
   }
-  return NULL;
 }
 
 cf_t cf_new_e() {
-  return cf_new_const(e_expansion);
+  return cf_new_indexed(e_expansion, NULL, NULL);
 }
 
 // 4/pi = 1 + 1/(3 + 4/(5 + 9/(7 + 16/(9 + ...))))
-static void *pi_arctan_sequence(cf_t cf) {
-  mpz_t num, denom;
-  mpz_init(num);
-  mpz_init(denom);
-
-  mpz_set_ui(denom, 1);
-  cf_put(cf, denom);
-  mpz_set_ui(num, 1);
-  cf_put(cf, num);
-  while(cf_wait(cf)) {
-    mpz_add_ui(denom, denom, 2);
-    cf_put(cf, denom);
-    mpz_add(num, num, denom);
-    cf_put(cf, num);
+// As a sequence: 1, 1, 3, 4, 5, 9, 7, 16, ...
+static void pi_arctan_sequence(mpz_t z, unsigned long i, void *data) {
+  if (i & 1) {
+    mpz_set_ui(z, (i + 1) / 2);
+    mpz_mul(z, z, z);
+  } else {
+    mpz_set_ui(z, i + 1);
   }
-
-  mpz_clear(num);
-  mpz_clear(denom);
-  return NULL;
 }
 
 static void *regularized_pi(cf_t cf) {
@@ -69,12 +53,15 @@ static void *regularized_pi(cf_t cf) {
   mpz_init(a); mpz_init(b); mpz_init(c); mpz_init(d);
   mpz_set_ui(a, 0); mpz_set_ui(b, 4);
   mpz_set_ui(c, 1); mpz_set_ui(d, 0);
-  cf_t nonregpi = cf_new(pi_arctan_sequence, NULL);
+  cf_t nonregpi = cf_new_indexed(pi_arctan_sequence, NULL, NULL);
   cf_t conv = cf_new_nonregular_to_cf(nonregpi, a, b, c, d);
   mpz_t z;
   mpz_init(z);
   while(cf_wait(cf)) {
-    cf_get(z, conv);
+    if (!cf_get(z, conv)) {
+      cf_put_end(cf);
+      break;
+    }
     cf_put(cf, z);
   }
   mpz_clear(z);
@@ -85,100 +72,148 @@ static void *regularized_pi(cf_t cf) {
 }
 
 // tan 1 = [1; 1, 1, 3, 1, 5, ...] 
-static void *tan1_expansion(cf_t cf) {
-  int odd = 1;
-
-  while(cf_wait(cf)) {
-    cf_put_int(cf, 1);
-    cf_put_int(cf, odd);
-    odd += 2;
-  }
-
-  return NULL;
+static void tan1_expansion(mpz_t z, unsigned long i, void *data) {
+  mpz_set_ui(z, i & 1 ? i : 1);
 }
 
 cf_t cf_new_tan1() {
-  return cf_new_const(tan1_expansion);
+  return cf_new_indexed(tan1_expansion, NULL, NULL);
 }
 
 // exp(z) = 1 + z/(1 - z/(2 + z/(3 - z/(2 + z/(5 - z/(2 + z/ ...))))))
-void *exp_expansion(cf_t cf) {
-  mpz_ptr z = cf_data(cf);
-  mpz_t minusz;
-  int odd = 1;
-  mpz_init(minusz);
-  mpz_neg(minusz, z);
-  cf_put_int(cf, 1);
-  while(cf_wait(cf)) {
-    cf_put(cf, z);
-    cf_put_int(cf, odd);
-    odd += 2;
-    cf_put(cf, minusz);
-    cf_put_int(cf, 2);
+// As a sequence: 1, z, 1, -z, 2, z, 3, -z, 2, ...
+static void exp_expansion(mpz_t z, unsigned long i, void *data) {
+  mpz_ptr x = data;
+  if (!i) {
+    mpz_set_ui(z, 1);
+    return;
+  }
+  i--;
+  switch(i % 4) {
+    case 0:
+      mpz_set(z, x);
+      break;
+    case 1:
+      mpz_set_ui(z, 2 * (i / 4) + 1);
+      break;
+    case 2:
+      mpz_neg(z, x);
+      break;
+    case 3:
+      mpz_set_ui(z, 2);
+      break;
   }
-  mpz_clear(minusz);
-  mpz_clear(z);
-  free(z);
-  return NULL;
 }
 
 // tanh n = z/(1 + z^2/(3 + z^2/(5 + z^2/...)))
-static void *gauss_tanh_expansion(cf_t cf) {
-  mpz_ptr z = cf_data(cf);
-  mpz_t z2;
-  mpz_t odd;
-  mpz_init(odd); mpz_init(z2);
-  mpz_set_ui(odd, 1);
-  mpz_set_ui(z2, 0);
-  cf_put(cf, z2);
-  cf_put(cf, z);
-  mpz_mul(z2, z, z);
-  while(cf_wait(cf)) {
-    cf_put(cf, odd);
-    mpz_add_ui(odd, odd, 2);
-    cf_put(cf, z2);
+// As a sequence: 0, z, 1, z^2, 3, z^2, ...
+static void gauss_tanh_expansion(mpz_t z, unsigned long i, void *data) {
+  mpz_ptr x = data;
+  if (!i) {
+    mpz_set_ui(z, 0);
+  } else if (i == 1) {
+    mpz_set(z, x);
+  } else if (i & 1) {
+    mpz_mul(z, x, x);
+  } else {
+    mpz_set_ui(z, i - 1);
   }
-  mpz_clear(odd); mpz_clear(z2);
-  mpz_clear(z);
-  free(z);
-  return NULL;
 }
 
 // tan n = z/(1 - z^2/(3 - z^2/(5 - z^2/...)))
-static void *gauss_tan_expansion(cf_t cf) {
-  mpz_ptr z = cf_data(cf);
-  mpz_t z2;
-  mpz_t odd;
-  mpz_init(odd); mpz_init(z2);
-  mpz_set_ui(odd, 1);
-  mpz_set_ui(z2, 0);
-  cf_put(cf, z2);
-  cf_put(cf, z);
-  mpz_mul(z2, z, z);
-  mpz_neg(z2, z2);
-  while(cf_wait(cf)) {
-    cf_put(cf, odd);
-    mpz_add_ui(odd, odd, 2);
-    cf_put(cf, z2);
-  }
-  mpz_clear(odd); mpz_clear(z2);
-  mpz_clear(z);
-  free(z);
-  return NULL;
+static void gauss_tan_expansion(mpz_t z, unsigned long i, void *data) {
+  gauss_tanh_expansion(z, i, data);
+  if (i > 1 && (i & 1)) mpz_neg(z, z);
+}
+
+static void clear_arg(void *data) {
+  mpz_clear(data);
+  free(data);
+}
+
+static cf_t new_one_arg(void (*term_at)(mpz_t z, unsigned long i, void *data),
+    mpz_t z) {
+  mpz_ptr p = malloc(sizeof(*p));
+  mpz_init(p);
+  mpz_set(p, z);
+  return cf_new_indexed_nonregular(term_at, clear_arg, p);
 }
 
 cf_t cf_new_epow(mpz_t pow) {
-  return cf_new_one_arg_nonregular(exp_expansion, pow);
+  return new_one_arg(exp_expansion, pow);
 }
 
 cf_t cf_new_tanh(mpz_t z) {
-  return cf_new_one_arg_nonregular(gauss_tanh_expansion, z);
+  return new_one_arg(gauss_tanh_expansion, z);
 }
 
 cf_t cf_new_tan(mpz_t z) {
-  return cf_new_one_arg_nonregular(gauss_tan_expansion, z);
+  return new_one_arg(gauss_tan_expansion, z);
 }
 
 cf_t cf_new_pi() {
   return cf_new_const(regularized_pi);
 }
+
+// log 2 = 3/4 sum_{k >= 0} (-1)^k (k!)^2 / (2^k (2k + 1)!)
+static void log2_term(mpz_t p, mpz_t q, mpz_t *a, mpz_t *b, unsigned long k,
+    void *data) {
+  if (!k) {
+    mpz_set_ui(p, 3);
+    mpz_set_ui(q, 4);
+  } else {
+    mpz_set_si(p, -k);
+    mpz_set_ui(q, 8 * k + 4);
+  }
+  mpz_set_ui(a[0], 1);
+  mpz_set_ui(b[0], 1);
+}
+
+cf_t cf_new_log2() {
+  return cf_new_series(log2_term, cf_series_tail_alternating, NULL, NULL);
+}
+
+// zeta(3) = 5/2 sum_{k >= 1} (-1)^(k+1) (k!)^2 / (k^3 (2k)!)
+static void zeta3_term(mpz_t p, mpz_t q, mpz_t *a, mpz_t *b, unsigned long k,
+    void *data) {
+  if (!k) {
+    mpz_set_ui(p, 5);
+    mpz_set_ui(q, 4);
+  } else {
+    mpz_set_si(p, -(k + 1));
+    mpz_set_ui(q, 4 * k + 2);
+  }
+  mpz_set_ui(a[0], 1);
+  mpz_ui_pow_ui(b[0], k + 1, 3);
+}
+
+cf_t cf_new_zeta3() {
+  return cf_new_series(zeta3_term, cf_series_tail_alternating, NULL, NULL);
+}
+
+// Catalan's constant, from Lupas' series:
+//   G = 1/64 sum_{n >= 1} (-1)^(n-1) 256^n (40n^2 - 24n + 3) (2n)!^3 (n!)^2
+//                         / (n^3 (2n - 1) (4n)!^2)
+// Consecutive terms without the polynomial factors have ratio
+//   -32 n^3 (2n - 1) / ((4n - 1)^2 (4n - 3)^2).
+static void catalan_term(mpz_t p, mpz_t q, mpz_t *a, mpz_t *b, unsigned long k,
+    void *data) {
+  unsigned long n = k + 1;
+  if (!k) {
+    mpz_set_ui(p, 1);
+    mpz_set_ui(q, 18);
+  } else {
+    mpz_ui_pow_ui(p, n, 3);
+    mpz_mul_ui(p, p, 32 * (2 * n - 1));
+    mpz_neg(p, p);
+    mpz_set_ui(q, (4 * n - 1) * (4 * n - 3));
+    mpz_mul(q, q, q);
+  }
+  mpz_set_ui(a[0], 40 * n * n - 24 * n + 3);
+  mpz_ui_pow_ui(b[0], n, 3);
+  mpz_mul_ui(b[0], b[0], 2 * n - 1);
+}
+
+cf_t cf_new_catalan() {
+  return cf_new_series(catalan_term, cf_series_tail_alternating, NULL, NULL);
+}
@@ -12,9 +12,17 @@ int main() {
   CF_NEW_EXPECT_DEC(cf_new_sqrt2, "1.41421356237309504880");
   CF_NEW_EXPECT_DEC(cf_new_e, "2.71828182845904523536");
   CF_NEW_EXPECT_DEC(cf_new_pi, "3.1415926535897932384");
+  CF_NEW_EXPECT_DEC(cf_new_pi_chudnovsky,
+      "3.14159265358979323846264338327950288419716939937510");
   CF_NEW_EXPECT_DEC(cf_new_tan1, "1.5574077246549022305");
   CF_NEW_EXPECT_DEC(cf_new_sin1, "0.8414709848078965066");
   CF_NEW_EXPECT_DEC(cf_new_cos1, "0.5403023058681397174");
+  CF_NEW_EXPECT_DEC(cf_new_log2,
+      "0.69314718055994530941723212145817656807550013436025");
+  CF_NEW_EXPECT_DEC(cf_new_zeta3,
+      "1.20205690315959428539973816151144999076498629234049");
+  CF_NEW_EXPECT_DEC(cf_new_catalan,
+      "0.91596559417721901505460351493238411077414937428167");
 
   mpz_t z;
   mpz_init(z);
@@ -30,6 +38,35 @@ int main() {
   CF_EXPECT_DEC(x, "7.38905609893065022723042746057500781318031557055184");
   cf_free(x);
 
+  x = cf_new_sin_int(69, 1);
+  CF_EXPECT_DEC(x, "-0.11478481378318722054507183355898007813");
+  cf_free(x);
+
+  x = cf_new_cos_int(64, 1);
+  CF_EXPECT_DEC(x, "0.39185723042955000516170985851312294209");
+  cf_free(x);
+
+  x = cf_new_sin_int(1, 3);
+  CF_EXPECT_DEC(x, "0.32719469679615224417334408526762060606");
+  cf_free(x);
+
+  x = cf_new_cos_int(-7, 2);
+  CF_EXPECT_DEC(x, "-0.93645668729079633769865762667176046301");
+  cf_free(x);
+
+  cf_t sc[2];
+  cf_new_sincos_int(sc, 69, 1);
+  CF_EXPECT_DEC(sc[1], "0.99339037972227163756154608488299961524");
+  CF_EXPECT_DEC(sc[0], "-0.11478481378318722054507183355898007813");
+  cf_free(sc[0]);
+  cf_free(sc[1]);
+
+  cf_new_sincos_int(sc, -7, 2);
+  CF_EXPECT_DEC(sc[0], "0.35078322768961984812036880004363558508");
+  CF_EXPECT_DEC(sc[1], "-0.93645668729079633769865762667176046301");
+  cf_free(sc[1]);
+  cf_free(sc[0]);
+
   mpz_clear(z);
   return 0;
 }
@@ -0,0 +1,29 @@
+// Prints the decimal expansion of an expression.
+//
+//   $ ./frac "sqrt(3/pi^2+e)/(tanh(sqrt(5))-sin(69))" 1000
+//
+// See cf_parse() for the syntax.
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include "cf.h"
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "usage: frac EXPR [DIGITS]\n");
+    return 1;
+  }
+  int n = 100;
+  if (argc > 2) {
+    n = atoi(argv[2]);
+    if (n <= 0) n = 100;
+  }
+  cf_t x = cf_parse(argv[1]);
+  if (!x) {
+    fprintf(stderr, "frac: cannot parse \"%s\"\n", argv[1]);
+    return 1;
+  }
+  cf_print_decimal(stdout, x, n);
+  cf_free(x);
+  return 0;
+}
@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <gmp.h>
@@ -82,6 +83,162 @@ void pqset_set_mobius(pqset_t pq, mobius_data_ptr md) {
   mpz_set(pq->qold, md->d); mpz_set(pq->q, md->c);
 }
 
+// A pqset in machine words, for when all entries are nonnegative and small.
+struct pqword_s {
+  long pold, p;
+  long qold, q;
+};
+typedef struct pqword_s pqword_t[1];
+typedef struct pqword_s *pqword_ptr;
+
+// Copies pq to w if it fits. Returns 0 otherwise.
+static int pqword_set(pqword_ptr w, pqset_t pq) {
+  pqword_t t;
+  if (!cf_word_get(&t->pold, pq->pold) || !cf_word_get(&t->p, pq->p)
+      || !cf_word_get(&t->qold, pq->qold) || !cf_word_get(&t->q, pq->q)) {
+    return 0;
+  }
+  *w = *t;
+  return 1;
+}
+
+static void pqword_get(pqset_t pq, pqword_ptr w) {
+  mpz_set_si(pq->pold, w->pold); mpz_set_si(pq->p, w->p);
+  mpz_set_si(pq->qold, w->qold); mpz_set_si(pq->q, w->q);
+}
+
+// pqset_regular_recur() on words. Leaves w alone and returns 0 on overflow.
+static int pqword_regular_recur(pqword_ptr w, mpz_t denom) {
+  long d, p, q;
+  if (!cf_word_get(&d, denom)
+      || !cf_word_muladd(&p, d, w->p, w->pold)
+      || !cf_word_muladd(&q, d, w->q, w->qold)) return 0;
+  w->pold = w->p; w->p = p;
+  w->qold = w->q; w->q = q;
+  return 1;
+}
+
+// If pold/qold and p/q have the same integer part, returns 1 and sets *t to
+// it, and *r0, *r1 to the remainders.
+static int pqword_quotient(long *t, long *r0, long *r1, pqword_ptr w) {
+  if (!w->qold || !w->q) return 0;
+  *t = w->pold / w->qold;
+  if (w->p / w->q != *t) return 0;
+  *r0 = w->pold % w->qold;
+  *r1 = w->p % w->q;
+  return 1;
+}
+
+// Lehmer's trick for big states: the leading bits of pq often determine
+// several output terms. We find them on single words, then apply them to
+// pq all at once, and check they were right.
+
+// Sets w to the top bits of pq, all shifted by the same amount so the
+// biggest has at most the given number of bits. Returns 0 if pq is small
+// or has a negative entry.
+static int pqword_top(pqword_ptr w, pqset_t pq, mpz_t t, size_t bits) {
+  if (mpz_sgn(pq->pold) < 0 || mpz_sgn(pq->p) < 0
+      || mpz_sgn(pq->qold) <= 0 || mpz_sgn(pq->q) <= 0) return 0;
+  size_t n = mpz_sizeinbase(pq->pold, 2);
+  if (n < mpz_sizeinbase(pq->p, 2)) n = mpz_sizeinbase(pq->p, 2);
+  if (n < mpz_sizeinbase(pq->qold, 2)) n = mpz_sizeinbase(pq->qold, 2);
+  if (n < mpz_sizeinbase(pq->q, 2)) n = mpz_sizeinbase(pq->q, 2);
+  if (n <= 2 * bits) return 0;
+  mpz_tdiv_q_2exp(t, pq->pold, n - bits); w->pold = mpz_get_si(t);
+  mpz_tdiv_q_2exp(t, pq->p,    n - bits); w->p    = mpz_get_si(t);
+  mpz_tdiv_q_2exp(t, pq->qold, n - bits); w->qold = mpz_get_si(t);
+  mpz_tdiv_q_2exp(t, pq->q,    n - bits); w->q    = mpz_get_si(t);
+  return 1;
+}
+
+// Sets z = a x + b y.
+static void mpz_lincomb(mpz_t z, long a, mpz_t x, long b, mpz_t y, mpz_t t) {
+  mpz_mul_si(z, x, a);
+  mpz_mul_si(t, y, b);
+  mpz_add(z, z, t);
+}
+
+// Outputs the next terms of the regular continued fraction of a big
+// nonnegative pq, several at once, and returns how many, or 0 if it cannot
+// find more than one. Uses tmp and t as scratch space.
+static int pqset_lehmer(cf_t cf, pqset_t pq, pqset_t tmp, mpz_t t) {
+  pqword_t w;
+  if (!pqword_top(w, pq, t, 62)) return 0;
+  // Cofactors: [c[0] c[1]; c[2] c[3]] maps (pold, qold) and (p, q) to
+  // their values after the terms so far.
+  long c[4] = { 1, 0, 0, 1 };
+  long term[64];
+  int n = 0;
+  // Cofactors grow as the remainders shrink. Stopping at half a word keeps
+  // the truncation error they amplify below the remainders.
+  while (n < 64 && w->qold >= 1L << 31 && w->q >= 1L << 31) {
+    long a, r0, r1;
+    if (!pqword_quotient(&a, &r0, &r1, w)) break;
+    term[n++] = a;
+    w->pold = w->qold; w->qold = r0;
+    w->p = w->q; w->q = r1;
+    long c0 = c[0], c1 = c[1];
+    c[0] = c[2]; c[2] = c0 - a * c[2];
+    c[1] = c[3]; c[3] = c1 - a * c[3];
+  }
+  if (n < 2) return 0;
+
+  // The terms were right if 0 <= qold < pold and 0 <= q < p afterwards:
+  // every term after the first is positive, and then the rest of each
+  // fraction exceeds 1.
+  mpz_lincomb(tmp->pold, c[0], pq->pold, c[1], pq->qold, t);
+  mpz_lincomb(tmp->qold, c[2], pq->pold, c[3], pq->qold, t);
+  mpz_lincomb(tmp->p, c[0], pq->p, c[1], pq->q, t);
+  mpz_lincomb(tmp->q, c[2], pq->p, c[3], pq->q, t);
+  if (mpz_sgn(tmp->qold) < 0 || mpz_cmp(tmp->qold, tmp->pold) >= 0
+      || mpz_sgn(tmp->q) < 0 || mpz_cmp(tmp->q, tmp->p) >= 0) return 0;
+  mpz_swap(pq->pold, tmp->pold); mpz_swap(pq->qold, tmp->qold);
+  mpz_swap(pq->p, tmp->p); mpz_swap(pq->q, tmp->q);
+  for (int i = 0; i < n; i++) {
+    mpz_set_si(t, term[i]);
+    cf_put(cf, t);
+  }
+  return n;
+}
+
+// Like pqset_lehmer(), but for decimal digits after the integer part: finds
+// how many digits the leading bits of pq agree on, then divides once by
+// 10^(k-1) times the denominators to check and extract k digits at once.
+static int pqset_lehmer_digits(cf_t cf, pqset_t pq, pqset_t tmp, mpz_t t) {
+  pqword_t w;
+  // Leave room for multiplying by 10.
+  if (!pqword_top(w, pq, t, 58)) return 0;
+  if (w->qold < 1L << 40 || w->q < 1L << 40) return 0;
+  int k = 0;
+  // About 40 bits of precision, or 12 digits.
+  while (k < 12) {
+    long a, r0, r1;
+    if (!pqword_quotient(&a, &r0, &r1, w) || a > 9) break;
+    k++;
+    w->pold = 10 * r0;
+    w->p = 10 * r1;
+  }
+  if (k < 2) return 0;
+
+  unsigned long pow10 = 1;
+  for (int i = 1; i < k; i++) pow10 *= 10;
+  mpz_mul_ui(tmp->pold, pq->pold, pow10);
+  mpz_fdiv_qr(tmp->pold, tmp->qold, tmp->pold, pq->qold);
+  mpz_mul_ui(tmp->p, pq->p, pow10);
+  mpz_fdiv_qr(tmp->p, tmp->q, tmp->p, pq->q);
+  if (mpz_cmp(tmp->pold, tmp->p) || mpz_cmp_ui(tmp->pold, pow10 * 10) >= 0) {
+    return 0;
+  }
+  unsigned long digits = mpz_get_ui(tmp->pold);
+  mpz_mul_ui(pq->pold, tmp->qold, 10);
+  mpz_mul_ui(pq->p, tmp->q, 10);
+  for (; pow10; pow10 /= 10) {
+    mpz_set_ui(t, digits / pow10 % 10);
+    cf_put(cf, t);
+  }
+  return k;
+}
+
 // Compute convergents of Mobius function applied to a regular
 // continued fraction.
 static void *mobius_convergent(cf_t cf) {
@@ -94,7 +251,10 @@ static void *mobius_convergent(cf_t cf) {
   mpz_t denom;
   mpz_init(denom);
   while(cf_wait(cf)) {
-    cf_get(denom, input);
+    if (!cf_get(denom, input)) {
+      cf_put_end(cf);
+      break;
+    }
     pqset_regular_recur(pq, denom);
 
     cf_put(cf, pq->p);
@@ -117,7 +277,9 @@ cf_t cf_new_mobius_convergent(cf_t x, mpz_t a, mpz_t b, mpz_t c, mpz_t d) {
   mpz_init(md->a); mpz_init(md->b); mpz_init(md->c); mpz_init(md->d);
   mpz_set(md->a, a); mpz_set(md->b, b); mpz_set(md->c, c); mpz_set(md->d, d);
   md->input = x;
-  return cf_new(mobius_convergent, md);
+  cf_t res = cf_new(mobius_convergent, md);
+  cf_add_input(res, x);
+  return res;
 }
 
 // Start a thread that, when signalled, computes the convergents of a continued
@@ -151,8 +313,7 @@ static void *nonregular_mobius_convergent(cf_t cf) {
   cf_get(denom, input);
   recur();
   while(cf_wait(cf)) {
-    cf_get(num, input);
-    cf_get(denom, input);
+    if (!cf_get(num, input) || !cf_get(denom, input)) break;
     recur();
   }
   mpz_clear(num);
@@ -170,7 +331,9 @@ cf_t cf_new_nonregular_mobius_convergent(cf_t x, mpz_t a, mpz_t b, mpz_t c, mpz_
   mpz_init(md->a); mpz_init(md->b); mpz_init(md->c); mpz_init(md->d);
   mpz_set(md->a, a); mpz_set(md->b, b); mpz_set(md->c, c); mpz_set(md->d, d);
   md->input = x;
-  return cf_new(nonregular_mobius_convergent, md);
+  cf_t res = cf_new(nonregular_mobius_convergent, md);
+  cf_add_input(res, x);
+  return res;
 }
 
 // Input: Mobius transformation and nonregular continued fraction.
@@ -182,9 +345,11 @@ static void *mobius_nonregular_throughput(cf_t cf) {
   mpz_t num; mpz_init(num);
   mpz_t denom; mpz_init(denom);
   mpz_t t0, t1, t2; mpz_init(t2); mpz_init(t1); mpz_init(t0);
+  pqset_t tmp; pqset_init(tmp);
   int recur() {
     pqset_nonregular_recur(pq, num, denom);
     pqset_remove_gcd(pq, t0, t1);
+    if (pqset_lehmer(cf, pq, tmp, t0)) return 1;
 
     if (mpz_sgn(pq->qold)) {
       mpz_fdiv_qr(t1, t0, pq->pold, pq->qold);
@@ -210,17 +375,17 @@ static void *mobius_nonregular_throughput(cf_t cf) {
     return 0;
   }
   mpz_set_ui(num, 1);
-  cf_get(denom, input);
-  recur();
-  while(cf_wait(cf)) {
+  int more = cf_get(denom, input);
+  if (more) recur();
+  while(more && cf_wait(cf)) {
     do {
-      cf_get(num, input);
-      cf_get(denom, input);
-    } while(!recur());
+      more = cf_get(num, input) && cf_get(denom, input);
+    } while(more && !recur());
   }
   mpz_clear(num);
   mpz_clear(denom);
   pqset_clear(pq);
+  pqset_clear(tmp);
 
   mpz_clear(md->a); mpz_clear(md->b); mpz_clear(md->c); mpz_clear(md->d);
   free(md);
@@ -233,7 +398,9 @@ cf_t cf_new_nonregular_to_cf(cf_t x, mpz_t a, mpz_t b, mpz_t c, mpz_t d) {
   mpz_init(md->a); mpz_init(md->b); mpz_init(md->c); mpz_init(md->d);
   mpz_set(md->a, a); mpz_set(md->b, b); mpz_set(md->c, c); mpz_set(md->d, d);
   md->input = x;
-  return cf_new(mobius_nonregular_throughput, md);
+  cf_t res = cf_new(mobius_nonregular_throughput, md);
+  cf_add_input(res, x);
+  return res;
 }
 
 // This seems to be slower than regularizing the continued fraction
@@ -271,13 +438,12 @@ static void *nonregular_mobius_decimal(cf_t cf) {
     return 0;
   }
   mpz_set_ui(num, 1);
-  cf_get(denom, input);
-  recur();
-  while(cf_wait(cf)) {
+  int more = cf_get(denom, input);
+  if (more) recur();
+  while(more && cf_wait(cf)) {
     do {
-      cf_get(num, input);
-      cf_get(denom, input);
-    } while(!recur());
+      more = cf_get(num, input) && cf_get(denom, input);
+    } while(more && !recur());
   }
   mpz_clear(num);
   mpz_clear(denom);
@@ -294,15 +460,37 @@ cf_t cf_new_nonregular_mobius_to_decimal(cf_t x, mpz_t a[4]) {
   mpz_set(md->a, a[0]); mpz_set(md->b, a[1]);
   mpz_set(md->c, a[2]); mpz_set(md->d, a[3]);
   md->input = x;
-  return cf_new(nonregular_mobius_decimal, md);
+  cf_t res = cf_new(nonregular_mobius_decimal, md);
+  cf_add_input(res, x);
+  return res;
 }
 
-static void determine_sign(cf_t cf, pqset_t pq, mpz_t denom, cf_t input) {
-  cf_set_sign(cf, cf_sign(input));
-  while (mpz_sgn(pq->pold) != mpz_sgn(pq->p)
-      || mpz_sgn(pq->qold) != mpz_sgn(pq->q)) {
-    cf_get(denom, input);
-    pqset_regular_recur(pq, denom);
+// Reads terms until the signs of pq settle, and makes them nonnegative.
+// Returns 0 if the input ends first, in which case the result is p/q, which
+// is made nonnegative instead.
+static int determine_sign(cf_t cf, pqset_t pq, mpz_t denom, cf_t input) {
+  // The sign of the input is only valid once we have read a term. Terms
+  // are those of |x|, so for negative x we negate the coefficients of x.
+  int more = cf_get(denom, input);
+  if (cf_sign(input) < 0) {
+    mpz_neg(pq->p, pq->p);
+    mpz_neg(pq->q, pq->q);
+  }
+  if (more) pqset_regular_recur(pq, denom);
+  while (more && (mpz_sgn(pq->pold) != mpz_sgn(pq->p)
+      || mpz_sgn(pq->qold) != mpz_sgn(pq->q))) {
+    if ((more = cf_get(denom, input))) pqset_regular_recur(pq, denom);
+  }
+  if (!more) {
+    if (mpz_sgn(pq->p) < 0) {
+      mpz_neg(pq->p, pq->p);
+      cf_flip_sign(cf);
+    }
+    if (mpz_sgn(pq->q) < 0) {
+      mpz_neg(pq->q, pq->q);
+      cf_flip_sign(cf);
+    }
+    return 0;
   }
   if (mpz_sgn(pq->qold) < 0) {
     mpz_neg(pq->qold, pq->qold);
@@ -314,6 +502,25 @@ static void determine_sign(cf_t cf, pqset_t pq, mpz_t denom, cf_t input) {
     mpz_neg(pq->p, pq->p);
     cf_flip_sign(cf);
   }
+  return 1;
+}
+
+// Bits of ad - bc, which bounds how much (ax + b)/(cx + d) magnifies errors
+// in x when |cx + d| >= 1.
+static unsigned long mobius_gain(mobius_data_ptr md) {
+  mpz_t t;
+  mpz_init(t);
+  mpz_mul(t, md->a, md->d);
+  mpz_submul(t, md->b, md->c);
+  unsigned long n = mpz_sizeinbase(t, 2);
+  mpz_clear(t);
+  return n;
+}
+
+// Passes on the precision readers want from cf to its input.
+static void want_bits_input(cf_t cf, cf_t input, unsigned long gain) {
+  unsigned long bits = cf_bits(cf);
+  if (bits) cf_want_bits(input, bits + gain);
 }
 
 // Input: Mobius transformation and regular continued fraction.
@@ -324,11 +531,30 @@ static void *mobius_throughput(cf_t cf) {
   pqset_t pq; pqset_init(pq); pqset_set_mobius(pq, md);
   mpz_t denom; mpz_init(denom);
   mpz_t t0, t1, t2; mpz_init(t2); mpz_init(t1); mpz_init(t0);
+  pqset_t tmp; pqset_init(tmp);
 
-  determine_sign(cf, pq, denom, input);
+  unsigned long gain = mobius_gain(md);
+  int more = determine_sign(cf, pq, denom, input);
+  // A copy of pq in machine words, used instead while small is set.
+  pqword_t w;
+  int small = pqword_set(w, pq);
 
   int recur() {
+    if (small) {
+      if (pqword_regular_recur(w, denom)) {
+        long t, r0, r1;
+        if (!pqword_quotient(&t, &r0, &r1, w)) return 0;
+        mpz_set_si(t1, t);
+        cf_put(cf, t1);
+        w->pold = w->qold; w->qold = r0;
+        w->p = w->q; w->q = r1;
+        return 1;
+      }
+      pqword_get(pq, w);
+      small = 0;
+    }
     pqset_regular_recur(pq, denom);
+    if (pqset_lehmer(cf, pq, tmp, t0)) return 1;
 
     if (mpz_sgn(pq->qold)) {
       mpz_fdiv_qr(t1, t0, pq->pold, pq->qold);
@@ -347,6 +573,7 @@ static void *mobius_throughput(cf_t cf) {
 	  mpz_set(pq->qold, t0);
 	  mpz_set(pq->p, pq->q);
 	  mpz_set(pq->q, t2);
+	  small = pqword_set(w, pq);
 	  return 1;
 	}
       }
@@ -354,12 +581,18 @@ static void *mobius_throughput(cf_t cf) {
     return 0;
   }
   while(cf_wait(cf)) {
-    do {
-      cf_get(denom, input);
-    } while(!recur());
+    want_bits_input(cf, input, gain);
+    while (more && (more = cf_get(denom, input)) && !recur());
+    if (!more) {
+      // The input has ended, at x = p/q.
+      if (small) pqword_get(pq, w);
+      cf_put_rational(cf, pq->p, pq->q);
+      break;
+    }
   }
   mpz_clear(denom);
   pqset_clear(pq);
+  pqset_clear(tmp);
   mpz_clear(t0); mpz_clear(t1); mpz_clear(t2);
   mpz_clear(md->a); mpz_clear(md->b); mpz_clear(md->c); mpz_clear(md->d);
   free(md);
@@ -372,7 +605,9 @@ cf_t cf_new_mobius_to_cf(cf_t x, mpz_t z[4]) {
   mpz_set(md->a, z[0]); mpz_set(md->b, z[1]);
   mpz_set(md->c, z[2]); mpz_set(md->d, z[3]);
   md->input = x;
-  return cf_new(mobius_throughput, md);
+  cf_t res = cf_new(mobius_throughput, md);
+  cf_add_input(res, x);
+  return res;
 }
 
 // Input: Mobius transformation and regular continued fraction.
@@ -384,10 +619,38 @@ static void *mobius_decimal(cf_t cf) {
   pqset_t pq; pqset_init(pq); pqset_set_mobius(pq, md);
   mpz_t denom; mpz_init(denom);
   mpz_t t0, t1, t2; mpz_init(t2); mpz_init(t1); mpz_init(t0);
+  pqset_t tmp; pqset_init(tmp);
 
-  determine_sign(cf, pq, denom, input);
+  int more = determine_sign(cf, pq, denom, input);
+  pqword_t w;
+  int small = pqword_set(w, pq);
   int recur() {
-    pqset_regular_recur(pq, denom);
+    if (small) {
+      if (pqword_regular_recur(w, denom)) {
+        long t, r0, r1;
+        if (!pqword_quotient(&t, &r0, &r1, w)) return 0;
+        if (r0 <= LONG_MAX / 10 && r1 <= LONG_MAX / 10) {
+          mpz_set_si(t1, t);
+          cf_put(cf, t1);
+          w->pold = r0 * 10;
+          w->p = r1 * 10;
+          return 1;
+        }
+        // Multiplying by 10 overflows, so finish this step with mpz_t.
+        pqword_get(pq, w);
+        small = 0;
+      } else {
+        pqword_get(pq, w);
+        small = 0;
+        pqset_regular_recur(pq, denom);
+      }
+    } else {
+      pqset_regular_recur(pq, denom);
+    }
+    if (pqset_lehmer_digits(cf, pq, tmp, t0)) {
+      small = pqword_set(w, pq);
+      return 1;
+    }
 
     // If the denominator is zero, we can't do anything yet.
     if (mpz_sgn(pq->qold)) {
@@ -419,6 +682,7 @@ static void *mobius_decimal(cf_t cf) {
 	  // Multiply numerator by 10.
 	  mpz_mul_ui(pq->pold, t0, 10);
 	  mpz_mul_ui(pq->p, t2, 10);
+	  small = pqword_set(w, pq);
 	  return 1;
 	}
       }
@@ -426,12 +690,26 @@ static void *mobius_decimal(cf_t cf) {
     return 0;
   }
   while(cf_wait(cf)) {
-    do {
-      cf_get(denom, input);
-    } while(!recur());
+    while (more && (more = cf_get(denom, input)) && !recur());
+    if (!more) {
+      // The input has ended, so we have p/q exactly, and can carry on
+      // with long division.
+      if (small) {
+        pqword_get(pq, w);
+        small = 0;
+      }
+      if (!mpz_sgn(pq->q)) {
+        cf_put_end(cf);
+        break;
+      }
+      mpz_fdiv_qr(t1, pq->p, pq->p, pq->q);
+      mpz_mul_ui(pq->p, pq->p, 10);
+      cf_put(cf, t1);
+    }
   }
   mpz_clear(denom);
   pqset_clear(pq);
+  pqset_clear(tmp);
   mpz_clear(t0); mpz_clear(t1); mpz_clear(t2);
   mpz_clear(md->a); mpz_clear(md->b); mpz_clear(md->c); mpz_clear(md->d);
   free(md);
@@ -443,7 +721,9 @@ cf_t cf_new_mobius_to_decimal(cf_t x, mpz_t a, mpz_t b, mpz_t c, mpz_t d) {
   mpz_init(md->a); mpz_init(md->b); mpz_init(md->c); mpz_init(md->d);
   mpz_set(md->a, a); mpz_set(md->b, b); mpz_set(md->c, c); mpz_set(md->d, d);
   md->input = x;
-  return cf_new(mobius_decimal, md);
+  cf_t res = cf_new(mobius_decimal, md);
+  cf_add_input(res, x);
+  return res;
 }
 
 cf_t cf_new_cf_to_decimal(cf_t x) {
@@ -461,28 +741,35 @@ struct funarg_s {
 };
 typedef struct funarg_s *funarg_ptr;
 
-static void *one_arg_nonregular(cf_t cf) {
-  funarg_ptr p = cf_data(cf);
+// Outputs the regular continued fraction of the nonregular continued
+// fraction x, which it frees afterwards.
+static void regularize(cf_t cf, cf_t nonregular) {
   mpz_t a, b, c, d;
   mpz_init(a); mpz_init(b); mpz_init(c); mpz_init(d);
   mpz_set_ui(a, 1); mpz_set_ui(b, 0);
   mpz_set_ui(c, 0); mpz_set_ui(d, 1);
-  mpz_ptr copy = malloc(sizeof(*copy));
-  mpz_init(copy);
-  mpz_set(copy, p->arg);
-  cf_t nonregular = cf_new(p->fun, copy);
   cf_t conv = cf_new_nonregular_to_cf(nonregular, a, b, c, d);
+  mpz_clear(a); mpz_clear(b); mpz_clear(c); mpz_clear(d);
   mpz_t z;
   mpz_init(z);
   while(cf_wait(cf)) {
-    cf_get(z, conv);
+    if (!cf_get(z, conv)) {
+      cf_put_end(cf);
+      break;
+    }
     cf_put(cf, z);
   }
   mpz_clear(z);
   cf_free(conv);
   cf_free(nonregular);
-  mpz_clear(a); mpz_clear(b); mpz_clear(c); mpz_clear(d);
+}
 
+static void *one_arg_nonregular(cf_t cf) {
+  funarg_ptr p = cf_data(cf);
+  mpz_ptr copy = malloc(sizeof(*copy));
+  mpz_init(copy);
+  mpz_set(copy, p->arg);
+  regularize(cf, cf_new(p->fun, copy));
   mpz_clear(p->arg);
   free(p);
   return NULL;
@@ -505,22 +792,7 @@ cf_t cf_new_one_arg_nonregular(void *(*fun)(cf_t), mpz_t z) {
 
 static void *nonreg_const(cf_t cf) {
   funarg_ptr p = cf_data(cf);
-  mpz_t a, b, c, d;
-  mpz_init(a); mpz_init(b); mpz_init(c); mpz_init(d);
-  mpz_set_ui(a, 1); mpz_set_ui(b, 0);
-  mpz_set_ui(c, 0); mpz_set_ui(d, 1);
-  cf_t nonregular = cf_new(p->fun, NULL);
-  cf_t conv = cf_new_nonregular_to_cf(nonregular, a, b, c, d);
-  mpz_clear(a); mpz_clear(b); mpz_clear(c); mpz_clear(d);
-  mpz_t z;
-  mpz_init(z);
-  while(cf_wait(cf)) {
-    cf_get(z, conv);
-    cf_put(cf, z);
-  }
-  mpz_clear(z);
-  cf_free(conv);
-  cf_free(nonregular);
+  regularize(cf, cf_new(p->fun, NULL));
   free(p);
   return NULL;
 }
@@ -530,3 +802,28 @@ cf_t cf_new_const_nonregular(void *(*fun)(cf_t)) {
   p->fun = fun;
   return cf_new(nonreg_const, p);
 }
+
+struct indexed_arg_s {
+  void (*term_at)(mpz_t z, unsigned long i, void *data);
+  void (*clear)(void *data);
+  void *data;
+};
+typedef struct indexed_arg_s *indexed_arg_ptr;
+
+static void *nonreg_indexed(cf_t cf) {
+  indexed_arg_ptr p = cf_data(cf);
+  regularize(cf, cf_new_indexed(p->term_at, p->clear, p->data));
+  free(p);
+  return NULL;
+}
+
+// Regular continued fraction of an indexed nonregular source.
+cf_t cf_new_indexed_nonregular(
+    void (*term_at)(mpz_t z, unsigned long i, void *data),
+    void (*clear)(void *data), void *data) {
+  indexed_arg_ptr p = malloc(sizeof(*p));
+  p->term_at = term_at;
+  p->clear = clear;
+  p->data = data;
+  return cf_new(nonreg_indexed, p);
+}
@@ -12,6 +12,21 @@ static void *sqrt2(cf_t cf) {
   return NULL;
 }
 
+// [1; 1, 10^30, 2, 2, ...]: the big term lets many output terms out at once.
+static void *burst(cf_t cf) {
+  mpz_t z;
+  mpz_init(z);
+  cf_put_int(cf, 1);
+  cf_put_int(cf, 1);
+  mpz_ui_pow_ui(z, 10, 30);
+  cf_put(cf, z);
+  while(cf_wait(cf)) {
+    cf_put_int(cf, 2);
+  }
+  mpz_clear(z);
+  return NULL;
+}
+
 // Converges extremely slowly.
 static void *slow_pi(cf_t cf) {
   mpz_t num, denom, t;
@@ -120,6 +135,29 @@ int main() {
   CF_EXPECT_DEC(mob, "2.4142135623730");
   cf_free(x);
   cf_free(mob);
+
+  // Overflows machine words early on.
+  x = cf_new_const(sqrt2);
+  mpz_ui_pow_ui(z[0], 10, 17);
+  mpz_set_si(z[1], 0);
+  mpz_set_si(z[2], 0);
+  mpz_set_si(z[3], 1);
+  mob = cf_new_mobius_to_cf(x, z);
+  CF_EXPECT_DEC(mob, "141421356237309504.88016887242096980785");
+  cf_free(x);
+  cf_free(mob);
+
+  // Big enough for several terms and digits at a time.
+  x = cf_new_const(burst);
+  mpz_ui_pow_ui(z[0], 3, 90);
+  mpz_ui_pow_ui(z[1], 5, 50);
+  mpz_ui_pow_ui(z[2], 7, 40);
+  mpz_ui_pow_ui(z[3], 11, 30);
+  mob = cf_new_mobius_to_cf(x, z);
+  CF_EXPECT_DEC(mob, "1368978419."
+      "0442351761063386149274229329949168650439418201258361870868672957138375");
+  cf_free(x);
+  cf_free(mob);
   for (int i = 0; i < 4; i++) mpz_clear(z[i]);
 
   return 0;
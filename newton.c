@@ -83,8 +83,49 @@ static void *newton(cf_t cf) {
   mpz_init(one);
   mpz_set_ui(one, 1);
 
+  // While small is set, the coefficients are kept in words w instead, in
+  // the order a0, a1, b0, b1, c0, c1, as in newton_integer().
+  mpz_ptr coeff[6] = { p->a0, p->a1, p->b0, p->b1, p->c0, p->c1 };
+  long w[6];
+  int small = 0;
+  void to_words() {
+    small = 1;
+    for (int i = 0; i < 6; i++) small = small && mpz_fits_slong_p(coeff[i]);
+    if (small) for (int i = 0; i < 6; i++) w[i] = mpz_get_si(coeff[i]);
+  }
+  void from_words() {
+    if (!small) return;
+    for (int i = 0; i < 6; i++) mpz_set_si(coeff[i], w[i]);
+    small = 0;
+  }
+
+  // Set once x has ended. Its tail is then infinite, so both columns hold
+  // the exact quadratic. A node being freed also ends up here, which is
+  // harmless as it stops at the next cf_wait().
+  int ended = 0;
   void move_right() {
-    cf_get(z, x);
+    if (ended) return;
+    if (!cf_get(z, x)) {
+      from_words();
+      ended = 1;
+      mpz_set(p->a0, p->a1);
+      mpz_set(p->b0, p->b1);
+      mpz_set(p->c0, p->c1);
+      return;
+    }
+    if (small) {
+      long q, u[3];
+      if (cf_word_get(&q, z) && cf_word_muladd(&u[0], q, w[1], w[0])
+          && cf_word_muladd(&u[1], q, w[3], w[2])
+          && cf_word_muladd(&u[2], q, w[5], w[4])) {
+        for (int k = 0; k < 3; k++) {
+          w[2 * k] = w[2 * k + 1];
+          w[2 * k + 1] = u[k];
+        }
+        return;
+      }
+      from_words();
+    }
     mpz_mul(t0, z, p->b1);
     mpz_add(t0, t0, p->b0);
     mpz_set(p->b0, p->b1);
@@ -96,7 +137,31 @@ static void *newton(cf_t cf) {
     mpz_set(p->a1, t0);     mpz_set(p->c1, t1);
   }
 
+  // move_down() on words with z = q. Returns 0 on overflow, leaving w
+  // alone.
+  int move_down_word(long q) {
+    long u[6];
+    for (int k = 0; k < 2; k++) {
+      long t, v, m;
+      if (!cf_word_muladd(&t, q, w[k], w[2 + k])
+          || __builtin_mul_overflow(q, w[4 + k], &v)
+          || __builtin_sub_overflow(v, w[k], &v)
+          || __builtin_mul_overflow(q, v, &m)
+          || __builtin_sub_overflow(t, m, &m)) return 0;
+      u[k] = v;
+      u[2 + k] = w[4 + k];
+      u[4 + k] = m;
+    }
+    for (int i = 0; i < 6; i++) w[i] = u[i];
+    return 1;
+  }
+
   void move_down() {
+    if (small) {
+      long q;
+      if (cf_word_get(&q, z) && move_down_word(q)) return;
+      from_words();
+    }
     // Recurrence relation with z, then
     // Subtract and invert z.
     mpz_mul(t0, z, p->a0);
@@ -116,6 +181,7 @@ static void *newton(cf_t cf) {
     mpz_set(p->b1, p->c1);
     mpz_sub(p->c1, t0, p->a1);
     mpz_set(p->a1, t1);
+    to_words();
   }
 
   int sign_quad() {
@@ -136,14 +202,112 @@ static void *newton(cf_t cf) {
     return mpz_sgn(t0);
   }
 
+  // Sets *sign to the sign of c z^2 - 2 a z - b for column k on words, or
+  // returns 0 on overflow.
+  int sign_quad_word(int *sign, int k, long z) {
+    __int128 t;
+    if (__builtin_mul_overflow((__int128) w[4 + k], z, &t)
+        || __builtin_sub_overflow(t, 2 * (__int128) w[k], &t)
+        || __builtin_mul_overflow(t, z, &t)
+        || __builtin_sub_overflow(t, w[2 + k], &t)) return 0;
+    *sign = (t > 0) - (t < 0);
+    return 1;
+  }
+
+  // The search of binary_search() on words, from lower. Returns 1 and sets
+  // z0 if both columns give the same integer part, 0 if x must move right
+  // first, or -1 on overflow.
+  int search_word(long lower) {
+    long lo = lower, hi, pow2 = 1, mid;
+    int sign, s;
+    if (!sign_quad_word(&sign, 0, lo)) return -1;
+    for (;;) {
+      if (__builtin_add_overflow(lo, pow2, &hi)
+          || !sign_quad_word(&s, 0, hi)) return -1;
+      if (s != sign) break;
+      if (__builtin_mul_overflow(pow2, 2, &pow2)) return -1;
+    }
+    for (;;) {
+      mid = lo + (hi - lo) / 2;
+      if (mid == lo) break;
+      if (!sign_quad_word(&s, 0, mid)) return -1;
+      if (s == sign) {
+	lo = mid;
+      } else {
+	hi = mid;
+      }
+    }
+    if (!sign_quad_word(&sign, 1, lo) || !sign_quad_word(&s, 1, hi)) {
+      return -1;
+    }
+    if (s == sign) return 0;
+    mpz_set_si(z0, lo);
+    return 1;
+  }
+
+  // Pass on the precision readers want, plus a rough allowance for how
+  // much the coefficients can magnify errors, as bihom.c does.
+  unsigned long gain = 0;
+  for (int i = 0; i < 6; i++) {
+    if (gain < mpz_sizeinbase(nd->a[i], 2)) gain = mpz_sizeinbase(nd->a[i], 2);
+  }
+  gain *= 2;
+  void want_bits() {
+    unsigned long bits = cf_bits(cf);
+    if (bits) cf_want_bits(x, bits + gain);
+  }
+
+  want_bits();
+  to_words();
   move_right();  // Get rid of pathological cases.
   move_right();
   move_right();
 
-  // Get integer part, starting search from given lower bound.
-  void binary_search(mpz_ptr lower) {
-    while (!mpz_sgn(p->c0)) move_right();
+  // Once x has ended: if the quadratic is linear, outputs its root
+  // -b0 / 2 a0, and if lower is a root, outputs that. Either way, or if no
+  // root lies above lower, ends the output and returns 1.
+  int exact(mpz_ptr lower) {
+    if (!mpz_sgn(p->c0)) {
+      mpz_mul_si(t1, p->a0, -2);
+      mpz_set(t0, p->b0);
+      if (mpz_sgn(t1) < 0) {
+        mpz_neg(t0, t0);
+        mpz_neg(t1, t1);
+      }
+      mpz_mul(t2, lower, t1);
+      if (mpz_sgn(t1) && mpz_cmp(t0, t2) >= 0) cf_put_rational(cf, t0, t1);
+      else cf_put_end(cf);
+      return 1;
+    }
+    mpz_set(z, lower);
+    int sign = sign_quad();
+    if (!sign) {
+      cf_put(cf, lower);
+      cf_put_end(cf);
+      return 1;
+    }
+    if (sign != mpz_sgn(p->c0)) return 0;
+    cf_put_end(cf);
+    return 1;
+  }
+
+  // Get integer part, starting search from given lower bound. Returns 0 if
+  // the output has ended instead.
+  int binary_search(mpz_ptr lower) {
     for (;;) {
+      // A column with no y^2 term may have no root at all, as for
+      // sqrt(2 pi), so we never search one.
+      while (!ended && !(small ? w[4] : mpz_sgn(p->c0))) move_right();
+      if (small && mpz_fits_slong_p(lower)) {
+        int r = search_word(mpz_get_si(lower));
+        if (r > 0) return 1;
+        if (!r) {
+          move_right();
+          continue;
+        }
+        from_words();
+      }
+      if (ended && exact(lower)) return 0;
       mpz_set(z0, lower);
       mpz_set(z, lower);
       int sign = sign_quad();
@@ -165,23 +329,32 @@ static void *newton(cf_t cf) {
 	  mpz_set(z1, z);
 	}
       }
+      if (ended) {
+        // The root may be the integer z1.
+        mpz_set(z, z1);
+        if (sign_quad()) return 1;
+        cf_put(cf, z1);
+        cf_put_end(cf);
+        return 0;
+      }
       sign = sign_quad1();
       mpz_set(z, z1);
-      if (sign_quad1() != sign) break;
+      if (sign_quad1() != sign) return 1;
       move_right();
     }
   }
 
-  binary_search(nd->lower);
-  cf_put(cf, z0);
-  mpz_set(z, z0);
-  move_down();
-
-  while(cf_wait(cf)) {
-    binary_search(one);
+  if (binary_search(nd->lower)) {
     cf_put(cf, z0);
     mpz_set(z, z0);
     move_down();
+    while(cf_wait(cf)) {
+      want_bits();
+      if (!binary_search(one)) break;
+      cf_put(cf, z0);
+      mpz_set(z, z0);
+      move_down();
+    }
   }
   abc_clear(p);
   mpz_clear(z); mpz_clear(z0); mpz_clear(z1); mpz_clear(pow2);
@@ -202,7 +375,9 @@ cf_t cf_new_newton(cf_t x, mpz_t a[6], mpz_t lower) {
   }
   mpz_init(p->lower);
   mpz_set(p->lower, lower);
-  return cf_new(newton, p);
+  cf_t res = cf_new(newton, p);
+  cf_add_input(res, x);
+  return res;
 }
 
 cf_t cf_new_sqrt(cf_t x) {
@@ -213,7 +388,9 @@ cf_t cf_new_sqrt(cf_t x) {
   // Solve y = x/y.
   mpz_set_si(p->a[1], 1);
   mpz_set_si(p->a[5], 1);
-  return cf_new(newton, p);
+  cf_t res = cf_new(newton, p);
+  cf_add_input(res, x);
+  return res;
 }
 
 struct newton_int_data_s {
@@ -269,8 +446,77 @@ static void *newton_integer(cf_t cf) {
     return mpz_sgn(t0);
   }
 
+  // While small is set, a, b, c are kept in wa, wb, wc instead. Their sizes
+  // stay bounded for roots of quadratics, so this is usually for good.
+  long wa, wb, wc;
+  int small = 0;
+  void to_words() {
+    small = mpz_fits_slong_p(a) && mpz_fits_slong_p(b) && mpz_fits_slong_p(c);
+    if (small) {
+      wa = mpz_get_si(a);
+      wb = mpz_get_si(b);
+      wc = mpz_get_si(c);
+    }
+  }
+
+  // Sets *sign to the sign of c z^2 - 2 a z - b on words, or returns 0 on
+  // overflow.
+  int sign_quad_word(int *sign, long z) {
+    __int128 t;
+    if (__builtin_mul_overflow((__int128) wc, z, &t)
+        || __builtin_sub_overflow(t, 2 * (__int128) wa, &t)
+        || __builtin_mul_overflow(t, z, &t)
+        || __builtin_sub_overflow(t, wb, &t)) return 0;
+    *sign = (t > 0) - (t < 0);
+    return 1;
+  }
+
+  // binary_search() on words. Returns 0 on overflow, leaving the state alone.
+  int binary_search_word(long lower) {
+    long lo = lower, hi, pow2 = 1, mid;
+    int sign, s;
+    if (!sign_quad_word(&sign, lo)) return 0;
+    for (;;) {
+      if (__builtin_add_overflow(lo, pow2, &hi)
+          || !sign_quad_word(&s, hi)) return 0;
+      if (s != sign) break;
+      if (__builtin_mul_overflow(pow2, 2, &pow2)) return 0;
+    }
+    for (;;) {
+      mid = lo + (hi - lo) / 2;
+      if (mid == lo) break;
+      if (!sign_quad_word(&s, mid)) return 0;
+      if (s == sign) {
+	lo = mid;
+      } else {
+	hi = mid;
+      }
+    }
+    // move_down() with lo.
+    long u0, u1, v;
+    if (!cf_word_muladd(&u0, lo, wa, wb)
+        || __builtin_mul_overflow(lo, wc, &u1)
+        || __builtin_sub_overflow(u1, wa, &u1)
+        || __builtin_mul_overflow(lo, u1, &v)
+        || __builtin_sub_overflow(u0, v, &v)) return 0;
+    wb = wc;
+    wc = v;
+    wa = u1;
+    mpz_set_si(z0, lo);
+    cf_put(cf, z0);
+    return 1;
+  }
+
   // Get integer part, starting search from given lower bound.
   void binary_search(mpz_ptr lower) {
+    if (small) {
+      if (mpz_fits_slong_p(lower)
+          && binary_search_word(mpz_get_si(lower))) return;
+      mpz_set_si(a, wa);
+      mpz_set_si(b, wb);
+      mpz_set_si(c, wc);
+      small = 0;
+    }
     mpz_set(z0, lower);
     mpz_set(z, lower);
     int sign = sign_quad();
@@ -295,8 +541,10 @@ static void *newton_integer(cf_t cf) {
     cf_put(cf, z0);
     mpz_set(z, z0);
     move_down();
+    to_words();
   }
 
+  to_words();
   binary_search(p->lower);
 
   while(cf_wait(cf)) {
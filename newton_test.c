@@ -16,6 +16,19 @@ static void *cot1_fn(cf_t cf) {
   return NULL;
 }
 
+static void expect_sqrt(long p, long q, char *dec, int line) {
+  mpq_t r;
+  mpq_init(r);
+  mpq_set_si(r, p, q);
+  cf_t x = cf_new_from_mpq(r);
+  cf_t y = cf_new_sqrt(x);
+  cf_expect_dec(y, dec, __FILE__, line);
+  cf_free(y);
+  cf_free(x);
+  mpq_clear(r);
+}
+#define EXPECT_SQRT(p, q, dec) expect_sqrt(p, q, dec, __LINE__)
+
 int main() {
   mpz_t a[6];
   int i;
@@ -56,6 +69,45 @@ int main() {
   CF_EXPECT_DEC(x, "1.77245392615830279609");
   cf_free(x);
 
+  // An input with no rational root: the search skips columns without a y^2
+  // term instead of doubling forever.
+  mpz8_set_int(b,
+      2, 0, 0, 1,
+      0, 0, 0, 0);
+  x = cf_new_pi();
+  bi = cf_new_mobius_to_cf(x, b);
+  n = cf_new_sqrt(bi);
+  CF_EXPECT_DEC(n, "2.50662827463100050241");
+  cf_free(n);
+  cf_free(bi);
+  cf_free(x);
+  // Precision wanted of the root reaches its input, with some to spare.
+  x = cf_new_pi();
+  bi = cf_new_mobius_to_cf(x, b);
+  n = cf_new_sqrt(bi);
+  cf_want_bits(n, 300);
+  EXPECT(cf_get(a[0], n) && cf_get(a[0], n));
+  EXPECT(cf_bits(bi) > 300);
+  cf_free(n);
+  cf_free(bi);
+  cf_free(x);
+
+  // Too big for machine words.
+  mpz_ui_pow_ui(a[0], 10, 40);
+  mpz_add_ui(a[0], a[0], 1);
+  mpz_set_ui(a[1], 3);
+  x = cf_new_sqrt_pq(a[0], a[1]);
+  CF_EXPECT_DEC(x, "57735026918962576450.91487805019574556476");
+  cf_free(x);
+
+  // Finite inputs, whose square roots may be rational.
+  EXPECT_SQRT(2, 1, "1.41421356237309504880");
+  EXPECT_SQRT(4, 1, "2.00000");
+  EXPECT_SQRT(9, 4, "1.50000");
+  EXPECT_SQRT(1, 9, "0.33333");
+  EXPECT_SQRT(0, 1, "0.00000");
+  EXPECT_SQRT(355, 113, "1.77245392615830279609");
+
   mpz8_clear(b);
   for (i = 0; i < 6; i++) mpz_clear(a[i]);
   return 0;
@@ -0,0 +1,752 @@
+// Expressions such as "sqrt(3/pi^2+e)/(tanh(sqrt(5))-sin(69))" compiled
+// into graphs of nodes.
+//
+// Parsing builds a DAG in which identical subexpressions are the same node,
+// and arithmetic on numbers is done on the spot. We then work out each node
+// as a bihomographic form
+//
+//   (a0 xy + a1 x + a2 y + a3) / (a4 xy + a5 x + a6 y + a7)
+//
+// of at most two continued fractions x and y, which we call variables.
+// Arithmetic with a number, or between two forms of one variable each,
+// gives another such form, so chains like 3/(pi*pi) become one bihom node.
+// Otherwise a form is turned into a variable of its own, computed by a
+// Mobius or bihom node. A variable read in several places is tee'd.
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "cf.h"
+
+enum {
+  // Numbers, constants and functions of numbers.
+  NODE_NUM, NODE_PI, NODE_E, NODE_LOG2, NODE_ZETA3, NODE_CATALAN,
+  NODE_SQRTQ, NODE_SIN, NODE_COS, NODE_TANH, NODE_EXP,
+  // 1 + k/(3 + k/(5 + ...)), so that tanh(sqrt(k)) = sqrt(k) / this.
+  NODE_TANHDEN,
+  // Functions of other nodes.
+  NODE_SQRT,
+  NODE_ADD, NODE_SUB, NODE_MUL, NODE_DIV,
+};
+
+struct node_s {
+  int kind;
+  int a, b;  // Operands, or -1.
+  mpq_t q;  // The number, or the argument of a function of a number.
+  // Filled in by form_of().
+  int done;
+  int form;  // Index of the form of the node.
+  int var;  // The variable holding the node's value, or -1.
+};
+
+// (a[0] xy + a[1] x + a[2] y + a[3]) / (a[4] xy + a[5] x + a[6] y + a[7]).
+// If y is -1 the coefficients involving y are zero, and likewise for x,
+// which is only -1 if y is.
+struct form_s {
+  int x, y;
+  mpz_t a[8];
+};
+typedef struct form_s *form_ptr;
+
+// A continued fraction in the graph: a leaf node, the square root of a
+// form, or a form computed by a Mobius or bihom node.
+struct var_s {
+  int node;  // The leaf or NODE_SQRT node, or -1.
+  int form;  // The form, or -1 for leaves.
+  int uses;
+  cf_t cf;
+  cf_t *out;  // One output for each use.
+  int taken;
+};
+
+struct parser_s {
+  const char *s;
+  struct node_s *node;
+  int n, nalloc;
+  struct form_s *form;
+  int nform, formalloc;
+  struct var_s *var;
+  int nvar, varalloc;
+  int err;  // Set on a syntax error or an unsupported expression.
+};
+typedef struct parser_s *parser_ptr;
+
+static void *grow(void *p, int *alloc, int n, size_t size) {
+  if (n < *alloc) return p;
+  *alloc = *alloc ? 2 * *alloc : 16;
+  return realloc(p, *alloc * size);
+}
+
+// Returns the node, reusing an identical one if there is one.
+static int node_new(parser_ptr ps, int kind, int a, int b, mpq_t q) {
+  // So that e*pi is found as a repeat of pi*e.
+  if ((kind == NODE_ADD || kind == NODE_MUL) && a > b) {
+    int t = a;
+    a = b;
+    b = t;
+  }
+  for (int i = 0; i < ps->n; i++) {
+    struct node_s *nd = ps->node + i;
+    if (nd->kind == kind && nd->a == a && nd->b == b
+        && (!q || mpq_equal(nd->q, q))) {
+      return i;
+    }
+  }
+  ps->node = grow(ps->node, &ps->nalloc, ps->n, sizeof(*ps->node));
+  struct node_s *nd = ps->node + ps->n;
+  nd->kind = kind;
+  nd->a = a;
+  nd->b = b;
+  mpq_init(nd->q);
+  if (q) mpq_set(nd->q, q);
+  nd->done = 0;
+  nd->var = -1;
+  return ps->n++;
+}
+
+static int node_leaf(parser_ptr ps, int kind) {
+  return node_new(ps, kind, -1, -1, NULL);
+}
+
+static int node_num_si(parser_ptr ps, long n) {
+  mpq_t q;
+  mpq_init(q);
+  mpq_set_si(q, n, 1);
+  int r = node_new(ps, NODE_NUM, -1, -1, q);
+  mpq_clear(q);
+  return r;
+}
+
+static int is_num(parser_ptr ps, int i) {
+  return ps->node[i].kind == NODE_NUM;
+}
+
+// Arithmetic, done at once on numbers.
+static int node_op(parser_ptr ps, int kind, int a, int b) {
+  if (a < 0 || b < 0) return -1;
+  if (!is_num(ps, a) || !is_num(ps, b)) return node_new(ps, kind, a, b, NULL);
+  mpq_t q;
+  mpq_init(q);
+  mpq_ptr x = ps->node[a].q, y = ps->node[b].q;
+  switch(kind) {
+    case NODE_ADD: mpq_add(q, x, y); break;
+    case NODE_SUB: mpq_sub(q, x, y); break;
+    case NODE_MUL: mpq_mul(q, x, y); break;
+    case NODE_DIV:
+      if (!mpq_sgn(y)) {
+        ps->err = 1;
+        mpq_clear(q);
+        return -1;
+      }
+      mpq_div(q, x, y);
+      break;
+  }
+  int r = node_new(ps, NODE_NUM, -1, -1, q);
+  mpq_clear(q);
+  return r;
+}
+
+static int node_neg(parser_ptr ps, int a) {
+  return node_op(ps, NODE_SUB, node_num_si(ps, 0), a);
+}
+
+// a^n by repeated squaring, so powers share their factors.
+static int node_pow(parser_ptr ps, int a, long n) {
+  if (n < 0) {
+    return node_op(ps, NODE_DIV, node_num_si(ps, 1), node_pow(ps, a, -n));
+  }
+  if (!n) return node_num_si(ps, 1);
+  if (n == 1) return a;
+  int h = node_pow(ps, a, n / 2);
+  int r = node_op(ps, NODE_MUL, h, h);
+  return n & 1 ? node_op(ps, NODE_MUL, r, a) : r;
+}
+
+// Whether q is an integer that fits in a long, which is then put in *n.
+static int q_get_si(long *n, mpq_t q) {
+  if (mpz_cmp_ui(mpq_denref(q), 1) || !mpz_fits_slong_p(mpq_numref(q))) {
+    return 0;
+  }
+  *n = mpz_get_si(mpq_numref(q));
+  return 1;
+}
+
+// Function of the node a, which may only be supported for some arguments.
+static int node_fn(parser_ptr ps, const char *name, int a) {
+  if (a < 0) return -1;
+  // Adding nodes may move the array, so we work on a copy.
+  int kind = ps->node[a].kind;
+  long n;
+  int r = -1;
+  mpq_t x, q;
+  mpq_init(x);
+  mpq_init(q);
+  mpq_set(x, ps->node[a].q);
+  if (!strcmp(name, "sqrt")) {
+    if (kind != NODE_NUM) {
+      r = node_new(ps, NODE_SQRT, a, -1, NULL);
+    } else if (mpq_sgn(x) >= 0) {
+      if (mpz_perfect_square_p(mpq_numref(x))
+          && mpz_perfect_square_p(mpq_denref(x))) {
+        mpz_sqrt(mpq_numref(q), mpq_numref(x));
+        mpz_sqrt(mpq_denref(q), mpq_denref(x));
+        r = node_new(ps, NODE_NUM, -1, -1, q);
+      } else {
+        r = node_new(ps, NODE_SQRTQ, -1, -1, x);
+      }
+    }
+  } else if (!strcmp(name, "sin") || !strcmp(name, "cos")) {
+    int sin = name[0] == 's';
+    if (kind == NODE_NUM) {
+      if (!mpq_sgn(x)) {
+        r = node_num_si(ps, !sin);
+      } else if (mpq_sgn(x) > 0) {
+        r = node_new(ps, sin ? NODE_SIN : NODE_COS, -1, -1, x);
+      } else {
+        mpq_neg(q, x);
+        r = node_new(ps, sin ? NODE_SIN : NODE_COS, -1, -1, q);
+        if (sin) r = node_neg(ps, r);
+      }
+    }
+  } else if (!strcmp(name, "tanh")) {
+    if (kind == NODE_SQRTQ && q_get_si(&n, x)) {
+      r = node_op(ps, NODE_DIV, a, node_new(ps, NODE_TANHDEN, -1, -1, x));
+    } else if (kind == NODE_NUM && q_get_si(&n, x)) {
+      mpq_abs(q, x);
+      r = !n ? a : node_new(ps, NODE_TANH, -1, -1, q);
+      if (n < 0) r = node_neg(ps, r);
+    }
+  } else if (!strcmp(name, "exp")) {
+    if (kind == NODE_NUM && q_get_si(&n, x)) {
+      if (!n) {
+        r = node_num_si(ps, 1);
+      } else {
+        mpq_abs(q, x);
+        r = n == 1 || n == -1 ? node_leaf(ps, NODE_E)
+            : node_new(ps, NODE_EXP, -1, -1, q);
+        if (n < 0) r = node_op(ps, NODE_DIV, node_num_si(ps, 1), r);
+      }
+    }
+  }
+  mpq_clear(x);
+  mpq_clear(q);
+  if (r < 0) ps->err = 1;
+  return r;
+}
+
+static void skip_space(parser_ptr ps) {
+  while (isspace((unsigned char) *ps->s)) ps->s++;
+}
+
+// Consumes c if it comes next.
+static int accept(parser_ptr ps, char c) {
+  skip_space(ps);
+  if (*ps->s != c) return 0;
+  ps->s++;
+  return 1;
+}
+
+static int parse_expr(parser_ptr ps);
+static int parse_unary(parser_ptr ps);
+
+// A decimal number, such as 2 or 0.125.
+static int parse_number(parser_ptr ps) {
+  mpq_t q;
+  mpq_init(q);
+  mpz_ptr num = mpq_numref(q), den = mpq_denref(q);
+  for (; isdigit((unsigned char) *ps->s); ps->s++) {
+    mpz_mul_ui(num, num, 10);
+    mpz_add_ui(num, num, *ps->s - '0');
+  }
+  if (*ps->s == '.') {
+    for (ps->s++; isdigit((unsigned char) *ps->s); ps->s++) {
+      mpz_mul_ui(num, num, 10);
+      mpz_add_ui(num, num, *ps->s - '0');
+      mpz_mul_ui(den, den, 10);
+    }
+  }
+  mpq_canonicalize(q);
+  int r = node_new(ps, NODE_NUM, -1, -1, q);
+  mpq_clear(q);
+  return r;
+}
+
+static int parse_atom(parser_ptr ps) {
+  skip_space(ps);
+  if (isdigit((unsigned char) *ps->s) || *ps->s == '.') {
+    return parse_number(ps);
+  }
+  if (accept(ps, '(')) {
+    int r = parse_expr(ps);
+    if (!accept(ps, ')')) return -1;
+    return r;
+  }
+  char name[16];
+  int len = 0;
+  while (isalnum((unsigned char) *ps->s)) {
+    if (len == sizeof(name) - 1) return -1;
+    name[len++] = *ps->s++;
+  }
+  name[len] = 0;
+  static const struct {
+    const char *name;
+    int kind;
+  } constant[] = {
+    { "pi", NODE_PI }, { "e", NODE_E }, { "log2", NODE_LOG2 },
+    { "zeta3", NODE_ZETA3 }, { "catalan", NODE_CATALAN },
+  };
+  for (int i = 0; i < sizeof(constant) / sizeof(*constant); i++) {
+    if (!strcmp(name, constant[i].name)) return node_leaf(ps, constant[i].kind);
+  }
+  if (!len || !accept(ps, '(')) return -1;
+  int a = parse_expr(ps);
+  if (!accept(ps, ')')) return -1;
+  return node_fn(ps, name, a);
+}
+
+// Powers must be integers, and bind tighter than unary minus on the left.
+static int parse_power(parser_ptr ps) {
+  int a = parse_atom(ps);
+  if (a < 0 || !accept(ps, '^')) return a;
+  int b = parse_unary(ps);
+  long n;
+  if (b < 0 || !is_num(ps, b) || !q_get_si(&n, ps->node[b].q)) {
+    ps->err = 1;
+    return -1;
+  }
+  if (n < 0 && is_num(ps, a) && !mpq_sgn(ps->node[a].q)) {
+    ps->err = 1;
+    return -1;
+  }
+  return node_pow(ps, a, n);
+}
+
+static int parse_unary(parser_ptr ps) {
+  if (accept(ps, '-')) return node_neg(ps, parse_unary(ps));
+  if (accept(ps, '+')) return parse_unary(ps);
+  return parse_power(ps);
+}
+
+static int parse_term(parser_ptr ps) {
+  int a = parse_unary(ps);
+  for (;;) {
+    if (accept(ps, '*')) {
+      a = node_op(ps, NODE_MUL, a, parse_unary(ps));
+    } else if (accept(ps, '/')) {
+      a = node_op(ps, NODE_DIV, a, parse_unary(ps));
+    } else {
+      return a;
+    }
+  }
+}
+
+static int parse_expr(parser_ptr ps) {
+  int a = parse_term(ps);
+  for (;;) {
+    if (accept(ps, '+')) {
+      a = node_op(ps, NODE_ADD, a, parse_term(ps));
+    } else if (accept(ps, '-')) {
+      a = node_op(ps, NODE_SUB, a, parse_term(ps));
+    } else {
+      return a;
+    }
+  }
+}
+
+static int form_new(parser_ptr ps) {
+  ps->form = grow(ps->form, &ps->formalloc, ps->nform, sizeof(*ps->form));
+  form_ptr f = ps->form + ps->nform;
+  f->x = f->y = -1;
+  for (int i = 0; i < 8; i++) mpz_init(f->a[i]);
+  return ps->nform++;
+}
+
+static int var_new(parser_ptr ps, int node, int form) {
+  ps->var = grow(ps->var, &ps->varalloc, ps->nvar, sizeof(*ps->var));
+  struct var_s *v = ps->var + ps->nvar;
+  v->node = node;
+  v->form = form;
+  v->uses = 0;
+  v->cf = NULL;
+  v->out = NULL;
+  v->taken = 0;
+  return ps->nvar++;
+}
+
+// A new form for variable v itself.
+static int form_var(parser_ptr ps, int v) {
+  int k = form_new(ps);
+  form_ptr f = ps->form + k;
+  f->x = v;
+  mpz_set_ui(f->a[1], 1);
+  mpz_set_ui(f->a[7], 1);
+  return k;
+}
+
+static int form_nvar(form_ptr f) {
+  return (f->x >= 0) + (f->y >= 0);
+}
+
+// r = pq, for polynomials c[0] xy + c[1] x + c[2] y + c[3] where p and q
+// have no variable in common.
+static void poly_mul(mpz_t r[4], mpz_t p[4], mpz_t q[4]) {
+  mpz_mul(r[0], p[0], q[3]);
+  mpz_addmul(r[0], p[1], q[2]);
+  mpz_addmul(r[0], p[2], q[1]);
+  mpz_addmul(r[0], p[3], q[0]);
+  mpz_mul(r[1], p[1], q[3]);
+  mpz_addmul(r[1], p[3], q[1]);
+  mpz_mul(r[2], p[2], q[3]);
+  mpz_addmul(r[2], p[3], q[2]);
+  mpz_mul(r[3], p[3], q[3]);
+}
+
+// Sets f to (c[0] v + c[1]) / (c[2] v + c[3]), where v may be -1 if c[0]
+// and c[2] are zero.
+static void form_set(form_ptr f, int v, mpz_t c[4]) {
+  mpz_t t[4];
+  for (int i = 0; i < 4; i++) mpz_init_set(t[i], c[i]);
+  for (int i = 0; i < 8; i++) mpz_set_ui(f->a[i], 0);
+  mpz_swap(f->a[1], t[0]);
+  mpz_swap(f->a[3], t[1]);
+  mpz_swap(f->a[5], t[2]);
+  mpz_swap(f->a[7], t[3]);
+  f->x = v;
+  f->y = -1;
+  for (int i = 0; i < 4; i++) mpz_clear(t[i]);
+}
+
+// Writes a bihom as (A v + B) / (C v + D) in one variable v, where
+// A = a[0] w + a[s] and B = a[t] w + a[t + s] in the other variable w, and C
+// and D likewise from a[4], ..., a[7]. Returns whether AD - BC is zero for
+// all w, when the bihom does not depend on v.
+static int det_zero(mpz_t *a, int s, int t) {
+  mpz_t u, v;
+  mpz_init(u);
+  mpz_init(v);
+  mpz_mul(u, a[0], a[4 + t]);
+  mpz_submul(u, a[t], a[4]);
+  int res = !mpz_sgn(u);
+  mpz_mul(u, a[0], a[4 + t + s]);
+  mpz_addmul(u, a[s], a[4 + t]);
+  mpz_mul(v, a[t], a[4 + s]);
+  mpz_addmul(v, a[t + s], a[4]);
+  res = res && !mpz_cmp(u, v);
+  mpz_mul(u, a[s], a[4 + t + s]);
+  mpz_submul(u, a[t + s], a[4 + s]);
+  res = res && !mpz_sgn(u);
+  mpz_clear(u);
+  mpz_clear(v);
+  return res;
+}
+
+// Drops variables a form does not depend on, and common factors.
+static void form_reduce(parser_ptr ps, form_ptr f) {
+  mpz_t *a = f->a;
+  if (f->y >= 0 && f->x == f->y && !mpz_sgn(a[0]) && !mpz_sgn(a[4])) {
+    // Linear in the one variable, as in pi + pi.
+    mpz_add(a[1], a[1], a[2]);
+    mpz_add(a[5], a[5], a[6]);
+    mpz_set_ui(a[2], 0);
+    mpz_set_ui(a[6], 0);
+  }
+  if (f->y >= 0 && !mpz_sgn(a[0]) && !mpz_sgn(a[2]) && !mpz_sgn(a[4])
+      && !mpz_sgn(a[6])) {
+    f->y = -1;
+  }
+  if (f->x >= 0 && !mpz_sgn(a[0]) && !mpz_sgn(a[1]) && !mpz_sgn(a[4])
+      && !mpz_sgn(a[5])) {
+    // Move y into the place of x.
+    f->x = f->y;
+    f->y = -1;
+    mpz_swap(a[1], a[2]);
+    mpz_swap(a[5], a[6]);
+  }
+  // A Mobius transformation with determinant zero is constant, as in pi/pi,
+  // and would never output a term. Likewise a bihom is constant in x when
+  // that of x is zero for every y, and in y when that of y is for every x.
+  mpz_t c[4];
+  for (int i = 0; i < 4; i++) mpz_init(c[i]);
+  if (f->y >= 0 && f->x != f->y) {
+    for (int s = 1; s <= 2; s++) {
+      int t = 3 - s;
+      if (!det_zero(a, s, t)) continue;
+      // Then f = A/C, or B/D if C = 0.
+      int k = mpz_sgn(a[4]) || mpz_sgn(a[4 + s]) ? 0 : t;
+      mpz_set(c[0], a[k]); mpz_set(c[1], a[k + s]);
+      mpz_set(c[2], a[4 + k]); mpz_set(c[3], a[4 + k + s]);
+      form_set(f, s == 1 ? f->y : f->x, c);
+      break;
+    }
+  }
+  if (f->x >= 0 && f->y < 0) {
+    mpz_mul(c[0], a[1], a[7]);
+    mpz_mul(c[1], a[3], a[5]);
+    if (!mpz_cmp(c[0], c[1])) {
+      // Then f = a1/a5, or a3/a7 if a5 = 0.
+      int k = mpz_sgn(a[5]) ? 1 : 3;
+      mpz_set_ui(c[0], 0); mpz_set(c[1], a[k]);
+      mpz_set_ui(c[2], 0); mpz_set(c[3], a[4 + k]);
+      form_set(f, -1, c);
+    }
+  }
+  for (int i = 0; i < 4; i++) mpz_clear(c[i]);
+  // Zero denominator.
+  if (!mpz_sgn(a[4]) && !mpz_sgn(a[5]) && !mpz_sgn(a[6]) && !mpz_sgn(a[7])) {
+    ps->err = 1;
+  }
+  mpz_t g;
+  mpz_init(g);
+  for (int i = 0; i < 8; i++) mpz_gcd(g, g, a[i]);
+  if (mpz_cmp_ui(g, 1) > 0) {
+    for (int i = 0; i < 8; i++) mpz_divexact(a[i], a[i], g);
+  }
+  mpz_clear(g);
+}
+
+static int form_of(parser_ptr ps, int n);
+
+// The form of node n as a variable of its own.
+static int var_of(parser_ptr ps, int n) {
+  struct node_s *nd = ps->node + n;
+  if (nd->var < 0) nd->var = var_new(ps, -1, form_of(ps, n));
+  return form_var(ps, nd->var);
+}
+
+// The form of a op b.
+static int form_op(parser_ptr ps, int op, int a, int b) {
+  int fu = form_of(ps, a), fv = form_of(ps, b);
+  if (ps->err) return -1;
+  // Forms of two variables only combine with numbers.
+  int nu = form_nvar(ps->form + fu), nv = form_nvar(ps->form + fv);
+  if (nu + nv > 2) {
+    if (nu == 2) fu = var_of(ps, a), nu = 1;
+    if (nv == 2) fv = var_of(ps, b), nv = 1;
+  }
+  int k = form_new(ps);
+  form_ptr r = ps->form + k, u = ps->form + fu, v = ps->form + fv;
+  mpz_t un[4], ud[4], vn[4], vd[4], t0[4], t1[4];
+  for (int i = 0; i < 4; i++) {
+    mpz_init_set(un[i], u->a[i]); mpz_init_set(ud[i], u->a[4 + i]);
+    mpz_init_set(vn[i], v->a[i]); mpz_init_set(vd[i], v->a[4 + i]);
+    mpz_init(t0[i]); mpz_init(t1[i]);
+  }
+  if (nu == 1 && nv == 1) {
+    // The variable of v becomes y, even if it is also that of u.
+    mpz_swap(vn[1], vn[2]);
+    mpz_swap(vd[1], vd[2]);
+    r->x = u->x;
+    r->y = v->x;
+  } else if (nu) {
+    r->x = u->x;
+    r->y = u->y;
+  } else {
+    r->x = v->x;
+    r->y = v->y;
+  }
+  switch(op) {
+    case NODE_ADD:
+    case NODE_SUB:
+      poly_mul(t0, un, vd);
+      poly_mul(t1, vn, ud);
+      for (int i = 0; i < 4; i++) {
+        (op == NODE_ADD ? mpz_add : mpz_sub)(r->a[i], t0[i], t1[i]);
+      }
+      poly_mul(t0, ud, vd);
+      break;
+    case NODE_MUL:
+      poly_mul(t1, un, vn);
+      for (int i = 0; i < 4; i++) mpz_set(r->a[i], t1[i]);
+      poly_mul(t0, ud, vd);
+      break;
+    case NODE_DIV:
+      poly_mul(t1, un, vd);
+      for (int i = 0; i < 4; i++) mpz_set(r->a[i], t1[i]);
+      poly_mul(t0, ud, vn);
+      break;
+  }
+  for (int i = 0; i < 4; i++) mpz_set(r->a[4 + i], t0[i]);
+  for (int i = 0; i < 4; i++) {
+    mpz_clear(un[i]); mpz_clear(ud[i]); mpz_clear(vn[i]); mpz_clear(vd[i]);
+    mpz_clear(t0[i]); mpz_clear(t1[i]);
+  }
+  form_reduce(ps, r);
+  return k;
+}
+
+static int form_of(parser_ptr ps, int n) {
+  struct node_s *nd = ps->node + n;
+  if (nd->done) return nd->form;
+  int k;
+  switch(nd->kind) {
+    case NODE_NUM:
+      k = form_new(ps);
+      mpz_set(ps->form[k].a[3], mpq_numref(nd->q));
+      mpz_set(ps->form[k].a[7], mpq_denref(nd->q));
+      break;
+    case NODE_ADD:
+    case NODE_SUB:
+    case NODE_MUL:
+    case NODE_DIV:
+      k = form_op(ps, nd->kind, nd->a, nd->b);
+      break;
+    case NODE_SQRT:
+      // The root reads the form of its operand.
+      nd->var = var_new(ps, n, form_of(ps, nd->a));
+      k = form_var(ps, nd->var);
+      break;
+    default:
+      nd->var = var_new(ps, n, -1);
+      k = form_var(ps, nd->var);
+      break;
+  }
+  nd->done = 1;
+  nd->form = k;
+  return k;
+}
+
+static void count_uses(parser_ptr ps, int k) {
+  form_ptr f = ps->form + k;
+  if (f->x >= 0) ps->var[f->x].uses++;
+  if (f->y >= 0) ps->var[f->y].uses++;
+}
+
+// The next unread output of variable v.
+static cf_t take(parser_ptr ps, int v) {
+  struct var_s *p = ps->var + v;
+  return p->out[p->taken++];
+}
+
+// 1, k, 3, k, 5, k, ...
+static void tanhden_term(mpz_t z, unsigned long i, void *data) {
+  if (i & 1) mpz_set(z, data);
+  else mpz_set_ui(z, i + 1);
+}
+
+static void clear_mpz(void *data) {
+  mpz_clear(data);
+  free(data);
+}
+
+static cf_t build_leaf(struct node_s *nd) {
+  mpz_ptr num = mpq_numref(nd->q), den = mpq_denref(nd->q);
+  switch(nd->kind) {
+    case NODE_PI: return cf_new_pi_chudnovsky();
+    case NODE_E: return cf_new_e();
+    case NODE_LOG2: return cf_new_log2();
+    case NODE_ZETA3: return cf_new_zeta3();
+    case NODE_CATALAN: return cf_new_catalan();
+    case NODE_SQRTQ: return cf_new_sqrt_pq(num, den);
+    case NODE_SIN: return cf_new_sin(num, den);
+    case NODE_COS: return cf_new_cos(num, den);
+    case NODE_TANH: return cf_new_tanh(num);
+    case NODE_EXP: return cf_new_epow(num);
+    case NODE_TANHDEN: {
+      mpz_ptr k = malloc(sizeof(*k));
+      mpz_init_set(k, num);
+      return cf_new_indexed_nonregular(tanhden_term, clear_mpz, k);
+    }
+  }
+  return NULL;
+}
+
+// Returns a handle of its own, so the caller frees the outputs it took.
+static cf_t build_form(parser_ptr ps, int k) {
+  form_ptr f = ps->form + k;
+  mpz_t *a = f->a;
+  if (f->x < 0) {
+    mpq_t q;
+    mpq_init(q);
+    mpz_set(mpq_numref(q), a[3]);
+    mpz_set(mpq_denref(q), a[7]);
+    mpq_canonicalize(q);
+    cf_t res = cf_new_from_mpq(q);
+    mpq_clear(q);
+    return res;
+  }
+  if (f->y < 0) {
+    if (!mpz_cmp(a[1], a[7]) && !mpz_sgn(a[3]) && !mpz_sgn(a[5])) {
+      return cf_ref(take(ps, f->x));
+    }
+    mpz_t m[4];
+    mpz_init_set(m[0], a[1]); mpz_init_set(m[1], a[3]);
+    mpz_init_set(m[2], a[5]); mpz_init_set(m[3], a[7]);
+    cf_t res = cf_new_mobius_to_cf(take(ps, f->x), m);
+    for (int i = 0; i < 4; i++) mpz_clear(m[i]);
+    return res;
+  }
+  cf_t x = take(ps, f->x);
+  return cf_new_bihom(x, take(ps, f->y), f->a);
+}
+
+// Tees cf into n outputs.
+static void fan_out(cf_t *out, cf_t cf, int n) {
+  for (; n > 1; n--) {
+    cf_t t[2];
+    cf_tee(t, cf);
+    cf_free(cf);
+    *out++ = t[0];
+    cf = t[1];
+  }
+  *out = cf;
+}
+
+static void parser_clear(parser_ptr ps) {
+  for (int i = 0; i < ps->n; i++) mpq_clear(ps->node[i].q);
+  for (int i = 0; i < ps->nform; i++) {
+    for (int j = 0; j < 8; j++) mpz_clear(ps->form[i].a[j]);
+  }
+  for (int i = 0; i < ps->nvar; i++) free(ps->var[i].out);
+  free(ps->node);
+  free(ps->form);
+  free(ps->var);
+}
+
+cf_t cf_parse(const char *s) {
+  struct parser_s ps[1];
+  memset(ps, 0, sizeof(ps));
+  ps->s = s;
+  int root = parse_expr(ps);
+  skip_space(ps);
+  if (root < 0 || *ps->s || ps->err) {
+    parser_clear(ps);
+    return NULL;
+  }
+  int k = form_of(ps, root);
+  if (ps->err) {
+    parser_clear(ps);
+    return NULL;
+  }
+  // Variables only read those made before them.
+  count_uses(ps, k);
+  for (int v = ps->nvar - 1; v >= 0; v--) {
+    struct var_s *p = ps->var + v;
+    if (p->uses && p->form >= 0) count_uses(ps, p->form);
+  }
+  for (int v = 0; v < ps->nvar; v++) {
+    struct var_s *p = ps->var + v;
+    if (!p->uses) continue;
+    if (p->form < 0) {
+      p->cf = build_leaf(ps->node + p->node);
+    } else {
+      cf_t x = build_form(ps, p->form);
+      if (p->node >= 0) {
+        p->cf = cf_new_sqrt(x);
+        cf_free(x);
+      } else {
+        p->cf = x;
+      }
+    }
+    p->out = malloc(sizeof(*p->out) * p->uses);
+    fan_out(p->out, p->cf, p->uses);
+  }
+  cf_t res = build_form(ps, k);
+  // Readers hold the handles they need, so the result keeps the graph.
+  for (int v = 0; v < ps->nvar; v++) {
+    struct var_s *p = ps->var + v;
+    for (int i = 0; i < p->uses; i++) cf_free(p->out[i]);
+  }
+  parser_clear(ps);
+  return res;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include "cf.h"
+#include "test.h"
+
+static unsigned long nodes() {
+  struct cf_stats_s st;
+  cf_stats(&st);
+  return st.nodes;
+}
+
+static unsigned long threads() {
+  struct cf_stats_s st;
+  cf_stats(&st);
+  return st.threads;
+}
+
+static void expect_parse(char *s, char *result, int line) {
+  cf_t x = cf_parse(s);
+  if (!x) {
+    fprintf(stderr, "%s:%d: cannot parse %s\n", __FILE__, line, s);
+    return;
+  }
+  cf_expect_dec(x, result, __FILE__, line);
+  cf_free(x);
+}
+#define EXPECT_PARSE(s, result) expect_parse(s, result, __LINE__)
+
+// Expects cf_print_decimal() to print the first line of frac's output.
+static void expect_print(char *s, int n, char *result, int line) {
+  cf_t x = cf_parse(s);
+  FILE *fp = tmpfile();
+  cf_print_decimal(fp, x, n);
+  cf_free(x);
+  rewind(fp);
+  char buf[128] = "";
+  if (!fgets(buf, sizeof(buf), fp) || strcmp(buf, result)) {
+    fprintf(stderr, "%s:%d: %s printed %s\n", __FILE__, line, s, buf);
+  }
+  fclose(fp);
+}
+#define EXPECT_PRINT(s, n, result) expect_print(s, n, result, __LINE__)
+
+int main() {
+  unsigned long nthread = threads();
+  EXPECT_PARSE("sqrt(3/pi^2+e)/(tanh(sqrt(5))-sin(69))",
+      "1.591709697431217535542284904695");
+  // Folded to a number.
+  EXPECT_PARSE("1/3 + 1/6", "0.5");
+  EXPECT_PARSE("2^-2 * 0.5", "0.12");
+  EXPECT_PARSE("-(e*e + e)", "-10.1073379273");
+  EXPECT_PARSE("(pi+1)/(pi-1)", "1.9338844138");
+  EXPECT_PARSE("pi + pi - 2*pi", "0");
+  // Constant Mobius and bihom forms fold too, rather than never giving a
+  // term.
+  EXPECT_PARSE("pi/pi", "1");
+  EXPECT_PARSE("(pi+1)/(2*pi+2)", "0.5");
+  EXPECT_PARSE("(pi-1)/(1-pi)", "-1");
+  EXPECT_PARSE("pi*e/(e*pi)", "1");
+  EXPECT_PARSE("(pi*e+pi)/(e+1)", "3.1415926535");
+  EXPECT_PARSE("sqrt(2)*3/4", "1.0606601717");
+  // Square roots of a lone variable.
+  EXPECT_PARSE("sqrt(pi)", "1.7724538509");
+  EXPECT_PARSE("sqrt(e)+1", "2.6487212707");
+  EXPECT_PARSE("sqrt(sqrt(2))", "1.1892071150");
+  EXPECT_PARSE("sqrt(sin(1))", "0.9173172759");
+  // Folds to the square root of a rational.
+  EXPECT_PARSE("sqrt(pi-pi+2)", "1.4142135623");
+  EXPECT_PARSE("sqrt(pi-pi+4)", "2.0000000000");
+  EXPECT_PARSE("log2*catalan", "0.6348989690");
+  EXPECT_PARSE("tanh(sqrt(7))", "0.9899820520");
+  EXPECT_PARSE("tanh(2)", "0.9640275800");
+  EXPECT_PARSE("exp(-2)", "0.1353352832");
+  EXPECT_PARSE("cos(-1)", "0.5403023058");
+  EXPECT_PARSE("sin(-1)", "-0.8414709848");
+  EXPECT(threads() == nthread);
+
+  // Negative results keep their sign, whether streamed or in bulk.
+  EXPECT_PRINT("1-pi", 10, "-2 \n");
+  EXPECT_PRINT("-pi", 20, "-3 \n");
+  EXPECT_PRINT("-pi", 10000, "-3 \n");
+  EXPECT_PRINT("pi", 10, "3 \n");
+
+  // One e, tee'd three ways: e, two tees, and two bihoms.
+  unsigned long n = nodes();
+  cf_t x = cf_parse("e*e + e");
+  EXPECT(nodes() - n == 5);
+  cf_expect_dec(x, "10.1073379273", __FILE__, __LINE__);
+  cf_free(x);
+  EXPECT(threads() == nthread);
+
+  char *bad[] = { "", "1/0", "2+", "(1", "1)", "foo", "pi^pi", "sin(pi)",
+      "sqrt(-4)", "exp(1/2)", "3/(pi-pi)" };
+  for (int i = 0; i < sizeof(bad) / sizeof(*bad); i++) {
+    EXPECT(!cf_parse(bad[i]));
+  }
+  return 0;
+}
@@ -0,0 +1,390 @@
+// Continued fractions of sums of series.
+//
+// A series is the sum over k >= 0 of
+//   a(k)/b(k) prod_{j = 0}^{k} p(j)/q(j)
+// for integers p, q, a, b supplied by the caller. Several outputs may share
+// p and q, each with its own weights a, b. We sum the first n terms by binary
+// splitting and ask the caller's tail function to bound the rest, which
+// gives rational lower and upper bounds r0, r1 on the target. We output a
+// term as soon as both bounds agree on it, and otherwise double n.
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include "cf.h"
+
+// Convergents of the output so far, and bounds on the target.
+//
+// Rather than comparing convergents against the bounds, which would cost
+// multiplications of large numbers for every term, we run Euclid's
+// algorithm on the bounds themselves. When the caller improves the bounds
+// r0, r1 it calls bracket_update(), which maps them through the inverse
+// of the convergent so far to bounds x0, x1 on the rest of the expansion.
+struct bracket_s {
+  mpz_t p0, q0;  // p0/q0 = last convergent
+  mpz_t p1, q1;  // p1/q1 = convergent
+  mpq_t r0;      // lower bound
+  mpq_t r1;      // upper bound
+  mpq_t x0, x1;  // Bounds on the rest. Infinite when the denominator is 0.
+  mpz_t t0, t1, t2;  // Temporary variables.
+  mpq_t tq0;
+  int i;  // Number of convergent we're computing.
+};
+typedef struct bracket_s bracket_t[1];
+typedef struct bracket_s *bracket_ptr;
+
+static void bracket_init(bracket_ptr b) {
+  mpq_init(b->r0); mpq_init(b->r1);
+  mpq_init(b->x0); mpq_init(b->x1);
+  mpz_init(b->p0); mpz_init(b->p1); mpz_init(b->q0); mpz_init(b->q1);
+  mpz_init(b->t0); mpz_init(b->t1); mpz_init(b->t2);
+  mpq_init(b->tq0);
+  // Initialize convergents: 0/1 and 1/0.
+  mpz_set_ui(b->q0, 1);
+  mpz_set_ui(b->p1, 1);
+  mpz_set_ui(mpq_denref(b->x1), 0);
+  b->i = 1;
+}
+
+static void bracket_clear(bracket_ptr b) {
+  mpq_clear(b->r0); mpq_clear(b->r1);
+  mpq_clear(b->x0); mpq_clear(b->x1);
+  mpz_clear(b->p0); mpz_clear(b->p1); mpz_clear(b->q0); mpz_clear(b->q1);
+  mpz_clear(b->t0); mpz_clear(b->t1); mpz_clear(b->t2);
+  mpq_clear(b->tq0);
+}
+
+// If r = N/D and y is the rest of the expansion, then
+//   r = (p1 y + p0)/(q1 y + q0)  =>  y = (p0 D - q0 N)/(q1 N - p1 D).
+// Returns the sign of the denominator, which we make nonnegative.
+static int bracket_map(mpq_ptr y, mpq_ptr r, bracket_ptr b) {
+  mpz_mul(b->t0, b->p0, mpq_denref(r));
+  mpz_mul(b->t1, b->q0, mpq_numref(r));
+  mpz_mul(b->t2, b->q1, mpq_numref(r));
+  mpz_submul(b->t2, b->p1, mpq_denref(r));
+  mpz_sub(mpq_numref(y), b->t0, b->t1);
+  mpz_swap(mpq_denref(y), b->t2);
+  int sign = mpz_sgn(mpq_denref(y));
+  if (sign < 0) {
+    mpz_neg(mpq_numref(y), mpq_numref(y));
+    mpz_neg(mpq_denref(y), mpq_denref(y));
+  }
+  return sign;
+}
+
+// Sets x0, x1 from r0, r1.
+static void bracket_update(bracket_ptr b) {
+  // If the bounds straddle the convergent so far, the rest is unbounded,
+  // so we wait for better bounds.
+  if (bracket_map(b->x0, b->r0, b) * bracket_map(b->x1, b->r1, b) <= 0) {
+    mpz_set_ui(mpq_denref(b->x1), 0);
+    return;
+  }
+  if (mpq_cmp(b->x0, b->x1) > 0) mpq_swap(b->x0, b->x1);
+}
+
+// Tries to find the next term. On success, returns 1 and sets z to the term.
+// Otherwise returns 0, and the bounds r0, r1 must be improved.
+static int bracket_next(mpz_t z, bracket_ptr b) {
+  if (!mpz_sgn(mpq_denref(b->x0)) || !mpz_sgn(mpq_denref(b->x1))) return 0;
+  // The term is the floor of both bounds, if they agree.
+  mpz_fdiv_q(b->t0, mpq_numref(b->x0), mpq_denref(b->x0));
+  mpz_fdiv_q(b->t1, mpq_numref(b->x1), mpq_denref(b->x1));
+  if (mpz_cmp(b->t0, b->t1)) return 0;
+  // Only the first term may be zero.
+  if (b->i > 1 && mpz_sgn(b->t0) <= 0) return 0;
+  mpz_set(z, b->t0);
+  b->i++;
+  mpz_addmul(b->p0, b->p1, b->t0);
+  mpz_addmul(b->q0, b->q1, b->t0);
+  mpz_swap(b->p1, b->p0);
+  mpz_swap(b->q1, b->q0);
+  // x0, x1 = 1/(x1 - z), 1/(x0 - z).
+  mpz_submul(mpq_numref(b->x0), mpq_denref(b->x0), z);
+  mpz_submul(mpq_numref(b->x1), mpq_denref(b->x1), z);
+  mpq_swap(b->x0, b->x1);
+  mpz_swap(mpq_numref(b->x0), mpq_denref(b->x0));
+  mpz_swap(mpq_numref(b->x1), mpq_denref(b->x1));
+  return 1;
+}
+
+// Binary splitting results for k in [lo, hi): P, Q are the products of
+// p(k), q(k), and for output i, B[i] is the product of b_i(k) and
+//   T[i] / (B[i] Q) = sum over k in [lo, hi) of
+//                     a_i(k)/b_i(k) prod_{j = lo}^{k} p(j)/q(j).
+struct split_s {
+  mpz_t P, Q;
+  mpz_t *B, *T;
+};
+typedef struct split_s split_t[1];
+typedef struct split_s *split_ptr;
+
+struct series_s {
+  int m;  // Number of outputs.
+  void (*term)(mpz_t p, mpz_t q, mpz_t *a, mpz_t *b, unsigned long k,
+      void *data);
+  int (*tail)(mpq_t bound, mpq_t t, unsigned long n, void *data);
+  void (*clear)(void *data);
+  void *data;
+  unsigned long n;  // Number of terms summed.
+  // Bits of precision of the last bounds, and before the last step.
+  long prec, prec_old;
+  unsigned long n_old;
+  split_t s;        // For k in [0, n).
+  mpz_t p, q, *a, *b;  // Scratch space for term().
+};
+typedef struct series_s *series_ptr;
+
+static void split_init(split_ptr s, int m) {
+  mpz_init(s->P); mpz_init(s->Q);
+  s->B = malloc(sizeof(*s->B) * m);
+  s->T = malloc(sizeof(*s->T) * m);
+  for (int i = 0; i < m; i++) mpz_init(s->B[i]), mpz_init(s->T[i]);
+}
+
+static void split_clear(split_ptr s, int m) {
+  mpz_clear(s->P); mpz_clear(s->Q);
+  for (int i = 0; i < m; i++) mpz_clear(s->B[i]), mpz_clear(s->T[i]);
+  free(s->B);
+  free(s->T);
+}
+
+// Appends s2 to s, destroying s2:
+//   T = B2 Q2 T1 + B1 P1 T2, P = P1 P2, Q = Q1 Q2, B = B1 B2.
+static void split_merge(split_ptr s, split_ptr s2, int m) {
+  for (int i = 0; i < m; i++) {
+    mpz_mul(s->T[i], s->T[i], s2->Q);
+    mpz_mul(s->T[i], s->T[i], s2->B[i]);
+    mpz_mul(s2->T[i], s2->T[i], s->P);
+    mpz_addmul(s->T[i], s2->T[i], s->B[i]);
+    mpz_mul(s->B[i], s->B[i], s2->B[i]);
+  }
+  mpz_mul(s->P, s->P, s2->P);
+  mpz_mul(s->Q, s->Q, s2->Q);
+}
+
+static void split(split_ptr s, series_ptr ser, unsigned long lo,
+    unsigned long hi) {
+  if (hi - lo == 1) {
+    ser->term(s->P, s->Q, s->T, s->B, lo, ser->data);
+    for (int i = 0; i < ser->m; i++) mpz_mul(s->T[i], s->T[i], s->P);
+    return;
+  }
+  unsigned long mid = lo + (hi - lo) / 2;
+  split_t s2;
+  split_init(s2, ser->m);
+  split(s, ser, lo, mid);
+  split(s2, ser, mid, hi);
+  split_merge(s, s2, ser->m);
+  split_clear(s2, ser->m);
+}
+
+// Sums more terms: twice as many, or if readers want more bits than that
+// is likely to give, about as many as they need, extrapolating from the
+// precision gained by the last step. As terms usually shrink ever faster,
+// this tends to fall short rather than overshoot.
+static void series_more(series_ptr ser, unsigned long bits) {
+  unsigned long n = 2 * ser->n;
+  long gained = ser->prec - ser->prec_old;
+  if ((long) bits > ser->prec && gained > 0) {
+    double want = ser->n + (double) (bits - ser->prec) / gained
+        * (ser->n - ser->n_old);
+    if (want > n && want < 1e15) n = want;
+  }
+  ser->n_old = ser->n;
+  ser->prec_old = ser->prec;
+  split_t s2;
+  split_init(s2, ser->m);
+  split(s2, ser, ser->n, n);
+  split_merge(ser->s, s2, ser->m);
+  split_clear(s2, ser->m);
+  ser->n = n;
+}
+
+// Sets r0 < r1 to bounds on output i, negated if the output is negative.
+// Returns 0 if the tail cannot be bounded yet. We avoid gcds by keeping
+// everything over common denominators.
+static int series_bounds(bracket_ptr b, series_ptr ser, int i, int sign) {
+  split_ptr s = ser->s;
+  // The first omitted term a(n) p(n) P / (b(n) q(n) Q), in absolute value.
+  ser->term(ser->p, ser->q, ser->a, ser->b, ser->n, ser->data);
+  mpz_mul(mpq_numref(b->tq0), ser->a[i], ser->p);
+  mpz_mul(mpq_numref(b->tq0), mpq_numref(b->tq0), s->P);
+  mpz_abs(mpq_numref(b->tq0), mpq_numref(b->tq0));
+  mpz_mul(mpq_denref(b->tq0), ser->b[i], ser->q);
+  mpz_mul(mpq_denref(b->tq0), mpq_denref(b->tq0), s->Q);
+  if (!ser->tail(b->r1, b->tq0, ser->n, ser->data)) return 0;
+  ser->prec = (long) mpz_sizeinbase(mpq_denref(b->r1), 2)
+      - (long) mpz_sizeinbase(mpq_numref(b->r1), 2);
+  // The partial sum T / (B Q), plus or minus the bound N / D on the tail:
+  //   (T D -+ N B Q) / (B Q D).
+  mpz_mul(b->t0, s->B[i], s->Q);
+  mpz_mul(b->t1, s->T[i], mpq_denref(b->r1));
+  if (sign < 0) mpz_neg(b->t1, b->t1);
+  mpz_mul(b->t2, mpq_numref(b->r1), b->t0);
+  mpz_mul(mpq_denref(b->r0), b->t0, mpq_denref(b->r1));
+  mpz_set(mpq_denref(b->r1), mpq_denref(b->r0));
+  mpz_sub(mpq_numref(b->r0), b->t1, b->t2);
+  mpz_add(mpq_numref(b->r1), b->t1, b->t2);
+  bracket_update(b);
+  return 1;
+}
+
+static void *series_expansion(cf_t cf) {
+  series_ptr ser = cf_data(cf);
+  int m = ser->m;
+  struct bracket_s *b = malloc(sizeof(*b) * m);
+  for (int i = 0; i < m; i++) bracket_init(&b[i]);
+  mpz_t z;
+  mpz_init(z);
+
+  void bounds(int i) {
+    while (!series_bounds(&b[i], ser, i, cf_sign(cf_output(cf, i)))) {
+      series_more(ser, 0);
+    }
+  }
+  // Most precision wanted from any output, with some to spare for
+  // finding terms.
+  unsigned long bits() {
+    unsigned long r = 0;
+    for (int i = 0; i < m; i++) {
+      if (r < cf_bits(cf_output(cf, i))) r = cf_bits(cf_output(cf, i));
+    }
+    return r ? r + 32 : 0;
+  }
+  // Find the signs.
+  for (int i = 0; i < m; i++) {
+    for (;;) {
+      bounds(i);
+      if (mpq_sgn(b[i].r0) > 0) break;
+      if (mpq_sgn(b[i].r1) < 0) {
+        cf_set_sign(cf_output(cf, i), -1);
+        bounds(i);
+        break;
+      }
+      series_more(ser, 0);
+    }
+  }
+
+  int mask;
+  while ((mask = cf_wait_multi(cf))) {
+    for (int i = 0; i < m; i++) {
+      if (!(mask & (1 << i))) continue;
+      while (!bracket_next(z, &b[i])) {
+        series_more(ser, bits());
+        for (int j = 0; j < m; j++) bounds(j);
+      }
+      cf_put(cf_output(cf, i), z);
+    }
+  }
+
+  for (int i = 0; i < m; i++) bracket_clear(&b[i]);
+  free(b);
+  mpz_clear(z);
+  split_clear(ser->s, m);
+  mpz_clear(ser->p); mpz_clear(ser->q);
+  for (int i = 0; i < m; i++) mpz_clear(ser->a[i]), mpz_clear(ser->b[i]);
+  free(ser->a);
+  free(ser->b);
+  if (ser->clear) ser->clear(ser->data);
+  free(ser);
+  return NULL;
+}
+
+void cf_new_series_multi(cf_t *out, int m,
+    void (*term)(mpz_t p, mpz_t q, mpz_t *a, mpz_t *b, unsigned long k,
+        void *data),
+    int (*tail)(mpq_t bound, mpq_t t, unsigned long n, void *data),
+    void (*clear)(void *data), void *data) {
+  series_ptr ser = malloc(sizeof(*ser));
+  ser->m = m;
+  ser->term = term;
+  ser->tail = tail;
+  ser->clear = clear;
+  ser->data = data;
+  mpz_init(ser->p); mpz_init(ser->q);
+  ser->a = malloc(sizeof(*ser->a) * m);
+  ser->b = malloc(sizeof(*ser->b) * m);
+  for (int i = 0; i < m; i++) mpz_init(ser->a[i]), mpz_init(ser->b[i]);
+  split_init(ser->s, m);
+  split(ser->s, ser, 0, 1);
+  ser->n = 1;
+  ser->prec = ser->prec_old = 0;
+  ser->n_old = 0;
+  cf_new_multi(out, m, series_expansion, ser);
+}
+
+cf_t cf_new_series(
+    void (*term)(mpz_t p, mpz_t q, mpz_t *a, mpz_t *b, unsigned long k,
+        void *data),
+    int (*tail)(mpq_t bound, mpq_t t, unsigned long n, void *data),
+    void (*clear)(void *data), void *data) {
+  cf_t cf;
+  cf_new_series_multi(&cf, 1, term, tail, clear, data);
+  return cf;
+}
+
+// For alternating series whose terms decrease in absolute value, the tail
+// is bounded by its first term.
+int cf_series_tail_alternating(mpq_t bound, mpq_t t, unsigned long n,
+    void *data) {
+  mpq_set(bound, t);
+  return 1;
+}
+
+// A node given only successively better bounds on its target.
+struct bracketed_s {
+  void (*refine)(mpq_t r0, mpq_t r1, void *data);
+  void (*clear)(void *data);
+  void *data;
+};
+typedef struct bracketed_s *bracketed_ptr;
+
+static void *bracketed_expansion(cf_t cf) {
+  bracketed_ptr bd = cf_data(cf);
+  bracket_t b;
+  bracket_init(b);
+  mpz_t z;
+  mpz_init(z);
+
+  void negate_bounds() {
+    mpq_neg(b->r0, b->r0);
+    mpq_neg(b->r1, b->r1);
+    mpq_swap(b->r0, b->r1);
+  }
+  void refine() {
+    bd->refine(b->r0, b->r1, bd->data);
+    if (cf_sign(cf) < 0) negate_bounds();
+    bracket_update(b);
+  }
+  // Find the sign.
+  for (;;) {
+    bd->refine(b->r0, b->r1, bd->data);
+    if (mpq_sgn(b->r0) > 0) break;
+    if (mpq_sgn(b->r1) < 0) {
+      cf_set_sign(cf, -1);
+      negate_bounds();
+      break;
+    }
+  }
+  bracket_update(b);
+
+  while (cf_wait(cf)) {
+    while (!bracket_next(z, b)) refine();
+    cf_put(cf, z);
+  }
+
+  bracket_clear(b);
+  mpz_clear(z);
+  if (bd->clear) bd->clear(bd->data);
+  free(bd);
+  return NULL;
+}
+
+cf_t cf_new_bracketed(void (*refine)(mpq_t r0, mpq_t r1, void *data),
+    void (*clear)(void *data), void *data) {
+  bracketed_ptr bd = malloc(sizeof(*bd));
+  bd->refine = refine;
+  bd->clear = clear;
+  bd->data = data;
+  return cf_new(bracketed_expansion, bd);
+}
@@ -1,192 +1,144 @@
+// Continued fractions of sin and cos at rational points from Taylor series,
+// summed by the series framework in series.c.
 #include <stdio.h>
 #include <stdlib.h>
 #include <gmp.h>
 #include "cf.h"
 
-// sin 1 from Taylor series
-static void *sin1_expansion(cf_t cf) {
-  mpz_t p0, q0;  // p0/q0 = last convergent
-  mpz_t p1, q1;  // p1/q1 = convergent
-  mpq_t r0;      // lower bound for sin 1
-  mpq_t r1;      // upper bound for sin 1
-  mpz_t t0, t1, t2;  // Temporary variables.
-  mpq_t tq0;
-
-  mpq_init(r0); mpq_init(r1);
-  mpz_init(p0); mpz_init(p1); mpz_init(q0); mpz_init(q1);
-  mpz_init(t0); mpz_init(t1); mpz_init(t2);
-  mpq_init(tq0);
-
-  // Zero causes all sorts of problems.
-  // Output it and forget about it.
-  cf_put_int(cf, 0);
-
-  // Initialize convergents.
-  mpz_set_ui(p0, 1);
-  mpz_set_ui(q1, 1);
-
-  // sin 1 = 1 - 1/6 + ...
-  mpq_set_ui(r0, 5, 6);
-  mpq_set_ui(r1, 1, 1);
-
-  int k = 1; // Number of Taylor series terms we've computed,
-             // numbered from 0, unlike continued fraction terms.
-  int i = 2; // Number of convergent we're computing.
-
-  void more_taylor() {
-    k++;
-    mpz_mul_ui(mpq_numref(r1), mpq_numref(r0), (2 * k) * (2 * k + 1));
-    mpz_mul_ui(mpq_denref(r1), mpq_denref(r0), (2 * k) * (2 * k + 1));
-    mpz_add_ui(mpq_numref(r1), mpq_numref(r1), 1);
-    k++;
-    mpz_mul_ui(mpq_numref(r0), mpq_numref(r1), (2 * k) * (2 * k + 1));
-    mpz_mul_ui(mpq_denref(r0), mpq_denref(r1), (2 * k) * (2 * k + 1));
-    mpz_sub_ui(mpq_numref(r0), mpq_numref(r0), 1);
+// Taylor series of sin(p/q) or cos(p/q). Term k is t0 times the product
+// over j = 1..k of -p^2 / (q^2 f(j)), where t0 = p/q and f(j) = 2j(2j+1)
+// for sin, and t0 = 1 and f(j) = (2j-1)2j for cos.
+//
+// With u_k the terms of the cos series, sin is the sum of
+// u_k p / (q (2k + 1)), so both can share the products over j as two
+// outputs with different weights.
+struct trig_s {
+  mpz_t p, q;
+  mpz_t p2, q2;  // p^2, q^2.
+  int is_cos;    // Whether the product is that of the cos series.
+  int m;         // Number of outputs. If 2, the first is sin.
+};
+typedef struct trig_s *trig_ptr;
+
+// q^2 f(j).
+static void trig_denom(mpz_t z, trig_ptr tr, unsigned long j) {
+  mpz_mul_ui(z, tr->q2, 2 * j);
+  mpz_mul_ui(z, z, tr->is_cos ? 2 * j - 1 : 2 * j + 1);
+}
+
+static void trig_term(mpz_t p, mpz_t q, mpz_t *a, mpz_t *b, unsigned long k,
+    void *data) {
+  trig_ptr tr = data;
+  if (!k) {
+    if (tr->is_cos) {
+      mpz_set_ui(p, 1);
+      mpz_set_ui(q, 1);
+    } else {
+      mpz_set(p, tr->p);
+      mpz_set(q, tr->q);
+    }
+  } else {
+    mpz_neg(p, tr->p2);
+    trig_denom(q, tr, k);
   }
-  while (cf_wait(cf)) {
-    for(;;) {
-      // Find largest x such that (p1 x + p0)/(q1 x + q0)
-      // <= r0 for odd i, and >= r1 for even i
-      //  =>  x < (q0 num(r) - p0 den(r))/(p1 den(r) - q1 num(r))
-      // for the appropriate r.
-      mpq_ptr r = i & 1 ? r0 : r1;
-      mpz_mul(t0, q0, mpq_numref(r));
-      mpz_mul(t1, p0, mpq_denref(r));
-      mpz_sub(t2, t0, t1);
-      mpz_mul(t0, p1, mpq_denref(r));
-      mpz_mul(t1, q1, mpq_numref(r));
-      mpz_sub(t1, t0, t1);
-      mpz_fdiv_q(t0, t2, t1);
-
-      // Then x is the next convergent provided substituting x + 1 overshoots
-      // the other bound. (If not, we need better bounds to decide.)
-      if (!mpz_sgn(t0)) {
-	more_taylor();
-      } else {
-	mpz_add_ui(t1, t0, 1);
-	mpz_set(mpq_numref(tq0), p0);
-	mpz_addmul(mpq_numref(tq0), p1, t1);
-	mpz_set(mpq_denref(tq0), q0);
-	mpz_addmul(mpq_denref(tq0), q1, t1);
-	if (i & 1) {
-	  if (mpq_cmp(tq0, r1) > 0) break;
-	  // Check (p1(x+1) + p0)/(q1(x+1) + q0) > r1
-	} else {
-	  if (mpq_cmp(tq0, r0) < 0) break;
-	  // Check (p1(x+1) + p0)/(q1(x+1) + q0) < r0
-	}
-	more_taylor();
-      }
-    };
-    cf_put(cf, t0);
-    i++;
-    mpz_addmul(p0, p1, t0);
-    mpz_addmul(q0, q1, t0);
-    mpz_swap(p1, p0);
-    mpz_swap(q1, q0);
+  mpz_set_ui(a[tr->m - 1], 1);
+  mpz_set_ui(b[tr->m - 1], 1);
+  if (tr->m == 2) {
+    mpz_set(a[0], tr->p);
+    mpz_mul_ui(b[0], tr->q, 2 * k + 1);
   }
+}
 
-  mpq_clear(r0); mpq_clear(r1);
-  mpz_clear(p0); mpz_clear(p1); mpz_clear(q0); mpz_clear(q1);
-  mpz_clear(t0); mpz_clear(t1); mpz_clear(t2);
-  mpq_clear(tq0);
-  return NULL;
+// The series alternate, and their terms decrease from the nth on when
+// p^2 < q^2 f(n + 1).
+static int trig_tail(mpq_t bound, mpq_t t, unsigned long n, void *data) {
+  trig_ptr tr = data;
+  mpz_t z;
+  mpz_init(z);
+  trig_denom(z, tr, n + 1);
+  int ok = mpz_cmp(tr->p2, z) < 0;
+  mpz_clear(z);
+  if (!ok) return 0;
+  return cf_series_tail_alternating(bound, t, n, data);
 }
 
-cf_t cf_new_sin1() {
-  return cf_new_const(sin1_expansion);
+static void trig_clear(void *data) {
+  trig_ptr tr = data;
+  mpz_clear(tr->p); mpz_clear(tr->q);
+  mpz_clear(tr->p2); mpz_clear(tr->q2);
+  free(tr);
 }
 
-// cos 1 from Taylor series
-static void *cos1_expansion(cf_t cf) {
-  mpz_t p0, q0;  // p0/q0 = last convergent
-  mpz_t p1, q1;  // p1/q1 = convergent
-  mpq_t r0;      // lower bound for sin 1
-  mpq_t r1;      // upper bound for sin 1
-  mpz_t t0, t1, t2;  // Temporary variables.
-  mpq_t tq0;
-
-  mpq_init(r0); mpq_init(r1);
-  mpz_init(p0); mpz_init(p1); mpz_init(q0); mpz_init(q1);
-  mpz_init(t0); mpz_init(t1); mpz_init(t2);
-  mpq_init(tq0);
-
-  // Zero causes all sorts of problems.
-  // Output it and forget about it.
-  cf_put_int(cf, 0);
-
-  // Initialize convergents.
-  mpz_set_ui(p0, 1);
-  mpz_set_ui(q1, 1);
-
-  // cos 1 = 1 - 1/2 + ...
-  mpq_set_ui(r0, 1, 2);
-  mpq_set_ui(r1, 1, 1);
-
-  int k = 1; // Number of Taylor series terms we've computed,
-             // numbered from 0, unlike continued fraction terms.
-  int i = 2; // Number of convergent we're computing.
-
-  void more_taylor() {
-    k++;
-    mpz_mul_ui(mpq_numref(r1), mpq_numref(r0), (2 * k) * (2 * k - 1));
-    mpz_mul_ui(mpq_denref(r1), mpq_denref(r0), (2 * k) * (2 * k - 1));
-    mpz_add_ui(mpq_numref(r1), mpq_numref(r1), 1);
-    k++;
-    mpz_mul_ui(mpq_numref(r0), mpq_numref(r1), (2 * k) * (2 * k - 1));
-    mpz_mul_ui(mpq_denref(r0), mpq_denref(r1), (2 * k) * (2 * k - 1));
-    mpz_sub_ui(mpq_numref(r0), mpq_numref(r0), 1);
-  }
-  while (cf_wait(cf)) {
-    for(;;) {
-      // Find largest x such that (p1 x + p0)/(q1 x + q0)
-      // <= r0 for odd i, and >= r1 for even i
-      //  =>  x < (q0 num(r) - p0 den(r))/(p1 den(r) - q1 num(r))
-      // for the appropriate r.
-      mpq_ptr r = i & 1 ? r0 : r1;
-      mpz_mul(t0, q0, mpq_numref(r));
-      mpz_mul(t1, p0, mpq_denref(r));
-      mpz_sub(t2, t0, t1);
-      mpz_mul(t0, p1, mpq_denref(r));
-      mpz_mul(t1, q1, mpq_numref(r));
-      mpz_sub(t1, t0, t1);
-      mpz_fdiv_q(t0, t2, t1);
-
-      // Then x is the next convergent provided substituting x + 1 overshoots
-      // the other bound. (If not, we need better bounds to decide.)
-      if (!mpz_sgn(t0)) {
-	more_taylor();
-      } else {
-	mpz_add_ui(t1, t0, 1);
-	mpz_set(mpq_numref(tq0), p0);
-	mpz_addmul(mpq_numref(tq0), p1, t1);
-	mpz_set(mpq_denref(tq0), q0);
-	mpz_addmul(mpq_denref(tq0), q1, t1);
-	if (i & 1) {
-	  if (mpq_cmp(tq0, r1) > 0) break;
-	  // Check (p1(x+1) + p0)/(q1(x+1) + q0) > r1
-	} else {
-	  if (mpq_cmp(tq0, r0) < 0) break;
-	  // Check (p1(x+1) + p0)/(q1(x+1) + q0) < r0
-	}
-	more_taylor();
-      }
-    };
-    cf_put(cf, t0);
-    i++;
-    mpz_addmul(p0, p1, t0);
-    mpz_addmul(q0, q1, t0);
-    mpz_swap(p1, p0);
-    mpz_swap(q1, q0);
+static trig_ptr trig_new(mpz_t p, mpz_t q, int is_cos, int m) {
+  trig_ptr tr = malloc(sizeof(*tr));
+  mpz_init(tr->p); mpz_init(tr->q);
+  mpz_init(tr->p2); mpz_init(tr->q2);
+  mpz_set(tr->p, p);
+  mpz_set(tr->q, q);
+  if (mpz_sgn(q) < 0) {
+    mpz_neg(tr->p, tr->p);
+    mpz_neg(tr->q, tr->q);
   }
+  mpz_mul(tr->p2, tr->p, tr->p);
+  mpz_mul(tr->q2, tr->q, tr->q);
+  tr->is_cos = is_cos;
+  tr->m = m;
+  return tr;
+}
+
+static cf_t new_trig(mpz_t p, mpz_t q, int is_cos) {
+  return cf_new_series(trig_term, trig_tail, trig_clear,
+      trig_new(p, q, is_cos, 1));
+}
+
+// sin(p/q) for p nonzero.
+cf_t cf_new_sin(mpz_t p, mpz_t q) {
+  return new_trig(p, q, 0);
+}
+
+// cos(p/q) for p nonzero.
+cf_t cf_new_cos(mpz_t p, mpz_t q) {
+  return new_trig(p, q, 1);
+}
 
-  mpq_clear(r0); mpq_clear(r1);
-  mpz_clear(p0); mpz_clear(p1); mpz_clear(q0); mpz_clear(q1);
-  mpz_clear(t0); mpz_clear(t1); mpz_clear(t2);
-  mpq_clear(tq0);
-  return NULL;
+static cf_t new_trig_int(int a, int b, int is_cos) {
+  mpz_t p, q;
+  mpz_init(p); mpz_init(q);
+  mpz_set_si(p, a);
+  mpz_set_si(q, b);
+  cf_t res = new_trig(p, q, is_cos);
+  mpz_clear(p); mpz_clear(q);
+  return res;
+}
+
+cf_t cf_new_sin_int(int a, int b) {
+  return new_trig_int(a, b, 0);
+}
+
+cf_t cf_new_cos_int(int a, int b) {
+  return new_trig_int(a, b, 1);
+}
+
+// out[0] = sin(p/q), out[1] = cos(p/q), for nonzero p, from one evaluation
+// of the Taylor series.
+void cf_new_sincos(cf_t out[2], mpz_t p, mpz_t q) {
+  cf_new_series_multi(out, 2, trig_term, trig_tail, trig_clear,
+      trig_new(p, q, 1, 2));
+}
+
+void cf_new_sincos_int(cf_t out[2], int a, int b) {
+  mpz_t p, q;
+  mpz_init(p); mpz_init(q);
+  mpz_set_si(p, a);
+  mpz_set_si(q, b);
+  cf_new_sincos(out, p, q);
+  mpz_clear(p); mpz_clear(q);
+}
+
+cf_t cf_new_sin1() {
+  return cf_new_sin_int(1, 1);
 }
 
 cf_t cf_new_cos1() {
-  return cf_new_const(cos1_expansion);
+  return cf_new_cos_int(1, 1);
 }
@@ -36,6 +36,11 @@ int main() {
   get(1, 10);
   get(0, 20);
 
+  // The input hears the most precision either side wants.
+  cf_want_bits(out[1], 500);
+  get(1, 20);
+  EXPECT(cf_bits(x) >= 500);
+
   cf_free(out[0]);
   get(1, 100);
   cf_free(out[1]);
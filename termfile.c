@@ -0,0 +1,286 @@
+// Files of precomputed terms, read back through mmap().
+//
+// A file is a 32-byte header, then the terms, then an index. All integers
+// in the header and index are little-endian:
+//
+//   0   "cfterms1"
+//   8   number of terms, 8 bytes
+//   16  offset of the index, 8 bytes
+//   24  index stride, 4 bytes
+//   28  sign, 1 byte: 0 positive, 1 negative
+//   29  1 if the expansion ends with the last term, 0 if it was cut short
+//   30  reserved, 2 bytes
+//
+// Each term a is a varint: 7 bits a byte, least significant first, with
+// the top bit set on all but the last byte. Terms below 2^63 are stored as
+// the varint 2a, and others as the varint 2n + 1 followed by the n bytes of
+// a, least significant first. Entry k of the index is the 8-byte offset of
+// term k * stride.
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <gmp.h>
+#include "cf.h"
+
+enum { HEADER_SIZE = 32, STRIDE = 64 };
+static const char magic[8] = "cfterms1";
+
+static void put_u64(unsigned char *p, uint64_t v, int n) {
+  for (int i = 0; i < n; i++) p[i] = v >> (8 * i);
+}
+
+static uint64_t get_u64(const unsigned char *p, int n) {
+  uint64_t v = 0;
+  for (int i = n - 1; i >= 0; i--) v = v << 8 | p[i];
+  return v;
+}
+
+static void put_varint(FILE *fp, uint64_t v, uint64_t *off) {
+  for (; v >= 0x80; v >>= 7, ++*off) putc((v & 0x7f) | 0x80, fp);
+  putc(v, fp);
+  ++*off;
+}
+
+// Returns the varint at *p, advancing it, or stops at end.
+static uint64_t get_varint(const unsigned char **p,
+    const unsigned char *end) {
+  uint64_t v = 0;
+  for (int shift = 0; *p < end && shift < 64; shift += 7) {
+    unsigned char c = *(*p)++;
+    v |= (uint64_t) (c & 0x7f) << shift;
+    if (!(c & 0x80)) break;
+  }
+  return v;
+}
+
+// Writes terms to a file as they come.
+struct termwriter_s {
+  FILE *fp;
+  uint64_t off;  // Where the next term goes.
+  uint64_t *index;
+  size_t nalloc;
+  unsigned char *buf;
+  size_t bufsize;
+  unsigned long n;  // Number of terms so far.
+  int sign;
+};
+typedef struct termwriter_s termwriter_t[1];
+typedef struct termwriter_s *termwriter_ptr;
+
+// Returns 0 if the file cannot be opened.
+static int termwriter_init(termwriter_ptr w, const char *path) {
+  if (!(w->fp = fopen(path, "wb"))) return 0;
+  unsigned char h[HEADER_SIZE];
+  memset(h, 0, sizeof(h));
+  fwrite(h, 1, sizeof(h), w->fp);
+  w->off = HEADER_SIZE;
+  w->nalloc = 64;
+  w->index = malloc(sizeof(*w->index) * w->nalloc);
+  w->bufsize = 64;
+  w->buf = malloc(w->bufsize);
+  w->n = 0;
+  w->sign = 1;
+  return 1;
+}
+
+static void termwriter_put(termwriter_ptr w, mpz_t z) {
+  if (!(w->n % STRIDE)) {
+    if (w->n / STRIDE == w->nalloc) {
+      w->index = realloc(w->index, sizeof(*w->index) * (w->nalloc *= 2));
+    }
+    w->index[w->n / STRIDE] = w->off;
+  }
+  w->n++;
+  if (mpz_sizeinbase(z, 2) < 64) {
+    put_varint(w->fp, (uint64_t) mpz_get_ui(z) << 1, &w->off);
+    return;
+  }
+  size_t len = (mpz_sizeinbase(z, 2) + 7) / 8;
+  if (len > w->bufsize) w->buf = realloc(w->buf, w->bufsize = len);
+  mpz_export(w->buf, &len, -1, 1, 0, 0, z);
+  put_varint(w->fp, (uint64_t) len << 1 | 1, &w->off);
+  fwrite(w->buf, 1, len, w->fp);
+  w->off += len;
+}
+
+// Writes the index and header, and closes the file. Returns 0 on error.
+static int termwriter_finish(termwriter_ptr w, int ended) {
+  unsigned long nindex = (w->n + STRIDE - 1) / STRIDE;
+  unsigned char e[8], h[HEADER_SIZE];
+  for (unsigned long k = 0; k < nindex; k++) {
+    put_u64(e, w->index[k], 8);
+    fwrite(e, 1, 8, w->fp);
+  }
+  free(w->index);
+  free(w->buf);
+  memset(h, 0, sizeof(h));
+  memcpy(h, magic, 8);
+  put_u64(h + 8, w->n, 8);
+  put_u64(h + 16, w->off, 8);
+  put_u64(h + 24, STRIDE, 4);
+  h[28] = w->sign < 0;
+  h[29] = ended;
+  rewind(w->fp);
+  fwrite(h, 1, sizeof(h), w->fp);
+  int ok = !ferror(w->fp);
+  if (fclose(w->fp)) ok = 0;
+  return ok;
+}
+
+int cf_write_file(const char *path, cf_t x, unsigned long n) {
+  termwriter_t w;
+  if (!termwriter_init(w, path)) return 0;
+  mpz_t z;
+  mpz_init(z);
+  int ended = 0;
+  while (w->n < n) {
+    if (!cf_get(z, x)) {
+      ended = !cf_cut(x);
+      break;
+    }
+    if (!w->n) w->sign = cf_sign(x);
+    termwriter_put(w, z);
+  }
+  mpz_clear(z);
+  return termwriter_finish(w, ended);
+}
+
+struct recorder_s {
+  cf_t x;
+  termwriter_t w;
+};
+typedef struct recorder_s *recorder_ptr;
+
+static void *recorder(cf_t cf) {
+  recorder_ptr r = cf_data(cf);
+  termwriter_ptr w = r->w;
+  mpz_t z;
+  mpz_init(z);
+  int ended = 0;
+  while (cf_wait(cf)) {
+    if (!cf_get(z, r->x)) {
+      // If x was cut short, so is our output, and so is the file.
+      ended = !cf_cut(r->x);
+      cf_put_end(cf);
+      break;
+    }
+    if (!w->n) cf_set_sign(cf, w->sign = cf_sign(r->x));
+    termwriter_put(w, z);
+    cf_put(cf, z);
+  }
+  termwriter_finish(w, ended);
+  mpz_clear(z);
+  free(r);
+  return NULL;
+}
+
+cf_t cf_new_recorder(cf_t x, const char *path) {
+  recorder_ptr r = malloc(sizeof(*r));
+  if (!termwriter_init(r->w, path)) {
+    free(r);
+    return NULL;
+  }
+  r->x = x;
+  cf_t res = cf_new(recorder, r);
+  cf_add_input(res, x);
+  return res;
+}
+
+struct termfile_s {
+  const unsigned char *map, *terms, *index;
+  size_t size;
+  uint64_t n, index_off;
+  unsigned stride;
+  // Where sequential reads left off, so they need not go through the index.
+  pthread_mutex_t mu;
+  uint64_t next;
+  const unsigned char *at;
+};
+typedef struct termfile_s *termfile_ptr;
+
+// Decodes the term at *p into z, advancing *p. Small terms need no
+// allocation once z has a limb.
+static void decode(mpz_t z, const unsigned char **p, termfile_ptr tf) {
+  const unsigned char *end = tf->map + tf->index_off;
+  uint64_t v = get_varint(p, end);
+  if (!(v & 1)) {
+    mpz_set_ui(z, v >> 1);
+    return;
+  }
+  size_t len = v >> 1;
+  if (len > (size_t) (end - *p)) len = end - *p;
+  mpz_import(z, len, -1, 1, 0, 0, *p);
+  *p += len;
+}
+
+static void termfile_term_at(mpz_t z, unsigned long i, void *data) {
+  termfile_ptr tf = data;
+  const unsigned char *p;
+  pthread_mutex_lock(&tf->mu);
+  if (tf->next == i) {
+    p = tf->at;
+  } else {
+    // Seek to the last indexed term at or before i.
+    unsigned long k = i / tf->stride;
+    p = tf->map + get_u64(tf->index + 8 * k, 8);
+    for (unsigned long j = k * tf->stride; j < i; j++) decode(z, &p, tf);
+  }
+  decode(z, &p, tf);
+  tf->next = i + 1;
+  tf->at = p;
+  pthread_mutex_unlock(&tf->mu);
+}
+
+static void termfile_clear(void *data) {
+  termfile_ptr tf = data;
+  munmap((void *) tf->map, tf->size);
+  pthread_mutex_destroy(&tf->mu);
+  free(tf);
+}
+
+cf_t cf_new_from_file(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (!fstat(fd, &st) && st.st_size >= HEADER_SIZE) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+  const unsigned char *h = map;
+  uint64_t n = get_u64(h + 8, 8), index_off = get_u64(h + 16, 8);
+  unsigned stride = get_u64(h + 24, 4);
+  if (memcmp(h, magic, 8) || !stride || index_off < HEADER_SIZE
+      || index_off > (uint64_t) st.st_size
+      || (n + stride - 1) / stride > (st.st_size - index_off) / 8) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  termfile_ptr tf = malloc(sizeof(*tf));
+  tf->map = map;
+  tf->size = st.st_size;
+  tf->terms = tf->map + HEADER_SIZE;
+  tf->index = tf->map + index_off;
+  tf->n = n;
+  tf->index_off = index_off;
+  tf->stride = stride;
+  pthread_mutex_init(&tf->mu, NULL);
+  tf->next = 0;
+  tf->at = tf->terms;
+  // Pages in as terms are read.
+  posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+  if (!h[29]) {
+    return cf_new_indexed_cut(termfile_term_at, termfile_clear, tf, n,
+        h[28] ? -1 : 1);
+  }
+  return cf_new_indexed_finite(termfile_term_at, termfile_clear, tf, n,
+      h[28] ? -1 : 1);
+}
@@ -0,0 +1,206 @@
+// Test writing terms to a file and reading them back.
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gmp.h>
+#include "cf.h"
+#include "test.h"
+
+// [1; 1, 10^30, 2, 10^60, 3, 10^90, ...]: big and small terms alternate.
+static void *mixed(cf_t cf) {
+  mpz_t z;
+  mpz_init(z);
+  cf_put_int(cf, 1);
+  for (int k = 1; cf_wait(cf); k++) {
+    cf_put_int(cf, k);
+    mpz_ui_pow_ui(z, 10, 30 * k);
+    cf_put(cf, z);
+  }
+  mpz_clear(z);
+  return NULL;
+}
+
+// Expects x and the file at path to give the same n terms, then the file
+// to end short of x.
+static void expect_same(cf_t x, char *path, int n) {
+  cf_t y = cf_new_from_file(path);
+  EXPECT(y);
+  mpz_t a, b;
+  mpz_init(a); mpz_init(b);
+  for (int i = 0; i < n; i++) {
+    EXPECT(cf_get(a, x) && cf_get(b, y) && !mpz_cmp(a, b));
+  }
+  EXPECT(cf_sign(x) == cf_sign(y));
+  EXPECT(!cf_get(b, y) && cf_cut(y));
+  mpz_clear(a); mpz_clear(b);
+  cf_free(y);
+}
+
+int main() {
+  char path[] = "/tmp/termfile_testXXXXXX";
+  int fd = mkstemp(path);
+  EXPECT(fd >= 0);
+  close(fd);
+
+  // More than one index stride, read in order and at random.
+  cf_t x = cf_new_e();
+  EXPECT(cf_write_file(path, x, 1000));
+  cf_free(x);
+  x = cf_new_e();
+  expect_same(x, path, 1000);
+  cf_free(x);
+  cf_t y = cf_new_from_file(path);
+  mpz_t z, w;
+  mpz_init(z); mpz_init(w);
+  x = cf_new_e();
+  for (unsigned long i = 999; i < 1000; i -= 37) {
+    EXPECT(cf_term_at(z, y, i) && cf_term_at(w, x, i) && !mpz_cmp(z, w));
+  }
+  EXPECT(!cf_term_at(z, y, 1000));
+  cf_free(x);
+  cf_free(y);
+
+  x = cf_new_const(mixed);
+  EXPECT(cf_write_file(path, x, 300));
+  cf_free(x);
+  x = cf_new_const(mixed);
+  expect_same(x, path, 300);
+  cf_free(x);
+
+  // A finite expansion, negative.
+  mpq_t q;
+  mpq_init(q);
+  mpq_set_str(q, "-123456789012345678901234567890/7", 10);
+  mpq_canonicalize(q);
+  x = cf_new_from_mpq(q);
+  EXPECT(cf_write_file(path, x, 1000000));
+  cf_free(x);
+  x = cf_new_from_file(path);
+  CF_EXPECT_DEC(x, "-17636684144620811271604938270");
+  EXPECT(!cf_cut(x));
+  cf_free(x);
+  mpq_clear(q);
+
+  // Recording what passes through: only the terms read, and the end.
+  x = cf_new_sqrt2();
+  y = cf_new_recorder(x, path);
+  for (int i = 0; i < 100; i++) EXPECT(cf_get(z, y));
+  cf_free(y);
+  cf_free(x);
+  x = cf_new_sqrt2();
+  expect_same(x, path, 100);
+  cf_free(x);
+  mpq_init(q);
+  mpq_set_str(q, "-22/7", 10);
+  x = cf_new_from_mpq(q);
+  y = cf_new_recorder(x, path);
+  CF_EXPECT_DEC(y, "-3.14285");
+  cf_free(y);
+  cf_free(x);
+  mpq_clear(q);
+  x = cf_new_from_file(path);
+  CF_EXPECT_DEC(x, "-3.14285");
+  cf_free(x);
+
+  // Readers of a file cut short end short too, instead of taking its last
+  // convergent as exact. The digits they give are still right.
+  x = cf_new_e();
+  EXPECT(cf_write_file(path, x, 10));
+  cf_free(x);
+  x = cf_new_from_file(path);
+  y = cf_new_cf_to_decimal(x);
+  char *e = "2718281828";
+  int i = 0;
+  for (; cf_get(z, y); i++) EXPECT(i < 10 && !mpz_cmp_ui(z, e[i] - '0'));
+  EXPECT(i >= 4 && cf_cut(y));
+  cf_free(y);
+  cf_free(x);
+  // Recording a replay keeps the file cut short.
+  char path2[] = "/tmp/termfile_testXXXXXX";
+  fd = mkstemp(path2);
+  EXPECT(fd >= 0);
+  close(fd);
+  x = cf_new_from_file(path);
+  y = cf_new_recorder(x, path2);
+  for (i = 0; cf_get(z, y); i++);
+  EXPECT(i == 10 && cf_cut(y));
+  cf_free(y);
+  cf_free(x);
+  x = cf_new_from_file(path2);
+  EXPECT(cf_cut(x));
+  cf_free(x);
+  unlink(path2);
+  // Both sides of a tee give every term before ending short, whichever is
+  // drained first.
+  x = cf_new_from_file(path);
+  cf_t t[2];
+  cf_tee(t, x);
+  for (int k = 0; k < 2; k++) {
+    for (i = 0; cf_get(z, t[k]); i++);
+    EXPECT(i == 10 && cf_cut(t[k]));
+  }
+  cf_free(t[0]);
+  cf_free(t[1]);
+  cf_free(x);
+  // Readers outside a node report what the bracket cannot settle, instead
+  // of taking 1457/536 as e.
+  x = cf_new_from_file(path);
+  EXPECT(isnan(cf_get_d(x)));
+  cf_free(x);
+  mpq_init(q);
+  x = cf_new_from_file(path);
+  EXPECT(!cf_eval_to_bits(x, 200, q));
+  cf_free(x);
+  x = cf_new_from_file(path);
+  EXPECT(cf_eval_to_bits(x, 10, q));
+  cf_free(x);
+  mpq_clear(q);
+  x = cf_new_from_file(path);
+  EXPECT(!cf_to_decimal_bulk(x, 20, NULL));
+  cf_free(x);
+  x = cf_new_from_file(path);
+  char *s = cf_to_decimal_bulk(x, 4, NULL);
+  EXPECT(s && !strcmp(s, "2.7182"));
+  free(s);
+  cf_free(x);
+  mpz_t max;
+  mpz_init_set_ui(max, 1000000000);
+  x = cf_new_from_file(path);
+  EXPECT(!cf_best_approx(x, max, z, w));
+  cf_free(x);
+  mpz_set_ui(max, 100);
+  x = cf_new_from_file(path);
+  EXPECT(cf_best_approx(x, max, z, w) && !mpz_cmp_ui(z, 193) &&
+      !mpz_cmp_ui(w, 71));
+  cf_free(x);
+  mpz_clear(max);
+  x = cf_new_from_file(path);
+  y = cf_new_e();
+  EXPECT(cf_cmp(x, y) == 2 && cf_cmp(y, x) == 2);
+  cf_free(y);
+  y = cf_new_from_file(path);
+  EXPECT(cf_cmp(x, y) == 2);
+  cf_free(y);
+  y = cf_new_sqrt2();
+  EXPECT(cf_cmp(x, y) == 1 && cf_floor(z, x) && !mpz_cmp_ui(z, 2));
+  EXPECT(cf_sign_of(x) == 1);
+  cf_free(y);
+  cf_free(x);
+  // A node reading it ends short before it knows the sign of x - e.
+  x = cf_new_from_file(path);
+  y = cf_new_e();
+  cf_t d = cf_new_sub(x, y);
+  EXPECT(cf_sign_of(d) == 2 && !cf_floor(z, d));
+  cf_free(d);
+  cf_free(y);
+  cf_free(x);
+
+  EXPECT(!cf_new_recorder(x, "/nonexistent/file"));
+  EXPECT(!cf_new_from_file("/nonexistent"));
+  mpz_clear(z); mpz_clear(w);
+  unlink(path);
+  return 0;
+}